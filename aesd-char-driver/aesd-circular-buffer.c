@@ -30,23 +30,95 @@
 struct aesd_buffer_entry *aesd_circular_buffer_find_entry_offset_for_fpos(struct aesd_circular_buffer *buffer,
             size_t char_offset, size_t *entry_offset_byte_rtn )
 {
-    struct aesd_buffer_entry *entry;
+    size_t base = buffer->entry_start[buffer->out_offs];
+    size_t lo, hi, slot;
 
-    size_t bytes_seen = 0;    
-    
-    for (uint8_t i=0; i < AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED; i++) {
-        entry = &buffer->entry[(i + buffer->out_offs) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+    if (char_offset >= buffer->end_offs - base) {
+        return NULL;
+    }
+
+    /*
+     * entry_start is monotonic in logical (oldest first) order, so binary search for the
+     * last entry starting at or before char_offset.  Zero length entries share their start
+     * with the following entry and are skipped by picking the last match.
+     */
+    lo = 0;
+    hi = aesd_circular_buffer_entry_count(buffer);
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        slot = buffer->out_offs + mid;
+        if (slot >= AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED) {
+            slot -= AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+        }
 
-        if (char_offset >= bytes_seen && char_offset < bytes_seen + entry->size) {
-            size_t char_pos = (char_offset - bytes_seen);
-            *entry_offset_byte_rtn = char_pos;
-            return entry;
+        if (buffer->entry_start[slot] - base <= char_offset) {
+            lo = mid;
+        } else {
+            hi = mid;
         }
-        bytes_seen += entry->size;
+    }
+
+    slot = buffer->out_offs + lo;
+    if (slot >= AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED) {
+        slot -= AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+    }
+
+    *entry_offset_byte_rtn = char_offset - (buffer->entry_start[slot] - base);
+    return &buffer->entry[slot];
+}
+
+/**
+ * @param buffer the buffer to search.  Any necessary locking must be performed by caller.
+ * @param n the zero referenced entry to return, 0 being the oldest retained entry
+ * @param entry_fpos_rtn is a pointer specifying a location to store the char_offset at which the
+ *      returned entry starts.  Only set when the entry exists.
+ * @return the n-th oldest entry, or NULL if fewer than n + 1 entries are retained.  Resolved in
+ *      constant time from entry_start.
+ */
+struct aesd_buffer_entry *aesd_circular_buffer_get_entry(struct aesd_circular_buffer *buffer,
+            size_t n, size_t *entry_fpos_rtn)
+{
+    size_t slot;
+
+    if (n >= aesd_circular_buffer_entry_count(buffer)) {
+        return NULL;
+    }
 
+    slot = buffer->out_offs + n;
+    if (slot >= AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED) {
+        slot -= AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
     }
 
-    return NULL;
+    *entry_fpos_rtn = buffer->entry_start[slot] - buffer->entry_start[buffer->out_offs];
+    return &buffer->entry[slot];
+}
+
+/**
+ * @param buffer the buffer to inspect.  Any necessary locking must be performed by caller.
+ * @return the number of entries currently retained in @param buffer
+ */
+size_t aesd_circular_buffer_entry_count(const struct aesd_circular_buffer *buffer)
+{
+    if (buffer->full) {
+        return AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED;
+    }
+
+    if (buffer->in_offs >= buffer->out_offs) {
+        return buffer->in_offs - buffer->out_offs;
+    }
+
+    return AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED - buffer->out_offs + buffer->in_offs;
+}
+
+/**
+ * @param buffer the buffer to inspect.  Any necessary locking must be performed by caller.
+ * @return the number of bytes retained in @param buffer, i.e. one past the largest
+ *      char_offset aesd_circular_buffer_find_entry_offset_for_fpos can resolve
+ */
+size_t aesd_circular_buffer_size(const struct aesd_circular_buffer *buffer)
+{
+    return buffer->end_offs - buffer->entry_start[buffer->out_offs];
 }
 
 /**
@@ -59,6 +131,8 @@ struct aesd_buffer_entry *aesd_circular_buffer_find_entry_offset_for_fpos(struct
 void aesd_circular_buffer_add_entry(struct aesd_circular_buffer *buffer, const struct aesd_buffer_entry *add_entry)
 {
     buffer->entry[buffer->in_offs] = *add_entry;
+    buffer->entry_start[buffer->in_offs] = buffer->end_offs;
+    buffer->end_offs += add_entry->size;
 
     if (buffer->full) {
         if (++(buffer->out_offs) == AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED) {
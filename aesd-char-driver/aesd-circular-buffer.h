@@ -10,13 +10,31 @@
 
 #ifdef __KERNEL__
 #include <linux/types.h>
+#include <linux/cache.h>
+#define AESD_CACHELINE_ALIGNED ____cacheline_aligned
 #else
 #include <stddef.h> // size_t
 #include <stdint.h> // uintx_t
 #include <stdbool.h>
+#define AESD_CACHELINE_ALIGNED __attribute__((aligned(64)))
 #endif
 
+/**
+ * Number of write commands retained.  May be overridden at build time, e.g. by the
+ * benchmarks in test/ which exercise much larger capacities.
+ */
+#ifndef AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED
 #define AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED 10
+#endif
+
+/**
+ * Type used for in_offs/out_offs, wide enough for the configured capacity
+ */
+#if AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED <= 255
+typedef uint8_t aesd_cb_index_t;
+#else
+typedef uint32_t aesd_cb_index_t;
+#endif
 
 struct aesd_buffer_entry
 {
@@ -32,19 +50,31 @@ struct aesd_buffer_entry
 
 struct aesd_circular_buffer
 {
+    /**
+     * Byte offset at which each entry starts, counted from the first byte ever added
+     * to the buffer.  Kept in its own cache aligned array, apart from the buffptr/size
+     * pairs in entry, so that offset lookups only pull in offset cache lines.
+     * The position of entry i relative to the oldest retained entry is
+     * entry_start[i] - entry_start[out_offs].
+     */
+    size_t entry_start[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED] AESD_CACHELINE_ALIGNED;
+    /**
+     * Offset one past the last byte added, i.e. where the next entry will start
+     */
+    size_t end_offs;
     /**
      * An array of pointers to memory allocated for the most recent write operations
      */
-    struct aesd_buffer_entry  entry[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+    struct aesd_buffer_entry  entry[AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED] AESD_CACHELINE_ALIGNED;
     /**
      * The current location in the entry structure where the next write should
      * be stored.
      */
-    uint8_t in_offs;
+    aesd_cb_index_t in_offs;
     /**
      * The first location in the entry structure to read from
      */
-    uint8_t out_offs;
+    aesd_cb_index_t out_offs;
     /**
      * set to true when the buffer entry structure is full
      */
@@ -54,6 +84,13 @@ struct aesd_circular_buffer
 extern struct aesd_buffer_entry *aesd_circular_buffer_find_entry_offset_for_fpos(struct aesd_circular_buffer *buffer,
             size_t char_offset, size_t *entry_offset_byte_rtn );
 
+extern struct aesd_buffer_entry *aesd_circular_buffer_get_entry(struct aesd_circular_buffer *buffer,
+            size_t n, size_t *entry_fpos_rtn);
+
+extern size_t aesd_circular_buffer_entry_count(const struct aesd_circular_buffer *buffer);
+
+extern size_t aesd_circular_buffer_size(const struct aesd_circular_buffer *buffer);
+
 extern void aesd_circular_buffer_add_entry(struct aesd_circular_buffer *buffer, const struct aesd_buffer_entry *add_entry);
 
 extern void aesd_circular_buffer_init(struct aesd_circular_buffer *buffer);
@@ -63,7 +100,7 @@ extern void aesd_circular_buffer_init(struct aesd_circular_buffer *buffer);
  * Useful when you've allocated memory for circular buffer entries and need to free it
  * @param entryptr is a struct aesd_buffer_entry* to set with the current entry
  * @param buffer is the struct aesd_buffer * describing the buffer
- * @param index is a uint8_t stack allocated value used by this macro for an index
+ * @param index is a stack allocated aesd_cb_index_t (uint8_t at the default capacity) used by this macro for an index
  * Example usage:
  * uint8_t index;
  * struct aesd_circular_buffer buffer;
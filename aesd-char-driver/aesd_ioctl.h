@@ -0,0 +1,46 @@
+/*
+ * aesd_ioctl.h
+ *
+ *  @brief Definitions for the ioctls supported by the aesdchar device, shared
+ *  between the driver and userspace.
+ */
+
+#ifndef AESD_IOCTL_H
+#define AESD_IOCTL_H
+
+#ifdef __KERNEL__
+#include <asm-generic/ioctl.h>
+#include <linux/types.h>
+#else
+#include <sys/ioctl.h>
+#include <stdint.h>
+#endif
+
+/**
+ * Argument for AESDCHAR_IOCSEEKTO
+ */
+struct aesd_seekto {
+    /**
+     * The zero referenced write command to seek into, 0 being the oldest retained
+     */
+    uint32_t write_cmd;
+    /**
+     * The zero referenced offset within the write command
+     */
+    uint32_t write_cmd_offset;
+};
+
+// Pick an arbitrary unused value from https://github.com/torvalds/linux/blob/master/Documentation/userspace-api/ioctl/ioctl-number.rst
+#define AESD_IOC_MAGIC 0x16
+
+/**
+ * Sets the file position to write_cmd_offset bytes into write command write_cmd.
+ * Fails with EINVAL if either is out of range for the retained history.
+ */
+#define AESDCHAR_IOCSEEKTO _IOWR(AESD_IOC_MAGIC, 1, struct aesd_seekto)
+/**
+ * The maximum number of commands supported, used for bounds checking
+ */
+#define AESDCHAR_IOC_MAXNR 1
+
+#endif /* AESD_IOCTL_H */
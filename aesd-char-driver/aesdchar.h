@@ -23,13 +23,41 @@
 #  define PDEBUG(fmt, args...) /* not debugging: nothing */
 #endif
 
+#include "aesd-circular-buffer.h"
+
+/**
+ * Bytes written but not yet terminated by \n
+ */
+struct aesd_staging
+{
+    char *buf;
+    size_t size;
+    size_t capacity;
+};
+
 struct aesd_dev
 {
-    /**
-     * TODO: Add structure(s) and locks needed to complete assignment requirements
-     */
+    struct mutex lock;                      /* protects buffer and orphan    */
+    struct aesd_circular_buffer buffer;     /* most recent write commands    */
+    struct aesd_staging orphan;             /* unterminated writes of closed files */
+    wait_queue_head_t readq;                /* woken on every committed write */
+    u64 committed;                          /* bytes ever committed, the absolute end of history */
     struct cdev cdev;     /* Char device structure      */
 };
 
+/**
+ * Per open file state, kept in filp->private_data.  Partial writes stage here so
+ * writers only take the device lock once a command is complete.
+ */
+struct aesd_file
+{
+    struct aesd_dev *dev;
+    struct mutex lock;                      /* protects staging              */
+    struct aesd_staging staging;
+    /* where the last read hit the end of history, both protected by dev->lock */
+    loff_t eof_pos;                         /* file position then, -1 if not at the end */
+    u64 eof_mark;                           /* dev->committed then */
+};
+
 
 #endif /* AESD_CHAR_DRIVER_AESDCHAR_H_ */
@@ -17,109 +17,676 @@
 #include <linux/types.h>
 #include <linux/cdev.h>
 #include <linux/fs.h> // file_operations
+#include <linux/kref.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+#include <linux/uio.h>
+#include <linux/version.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
 #include "aesdchar.h"
+#include "aesd_ioctl.h"
 int aesd_major =   0; // use dynamic major
 int aesd_minor =   0;
 
+static bool aesd_blocking_read = false;
+module_param_named(blocking_read, aesd_blocking_read, bool, 0644);
+MODULE_PARM_DESC(blocking_read, "Block reads at the end of the history until a new write is committed");
+
+static unsigned int aesd_nr_devs = 1;
+module_param_named(nr_devs, aesd_nr_devs, uint, 0444);
+MODULE_PARM_DESC(nr_devs, "Number of aesdchar devices, each with its own history and lock");
+
 MODULE_AUTHOR("Jade Angrboða");
 MODULE_LICENSE("Dual BSD/GPL");
 
-struct aesd_dev aesd_device;
+struct aesd_dev *aesd_devices;
+
+static int aesd_staging_reserve(struct aesd_staging *staging, size_t size);
+
+static inline struct aesd_dev *aesd_file_dev(struct file *filp) {
+    return ((struct aesd_file *)filp->private_data)->dev;
+}
 
 int aesd_open(struct inode *inode, struct file *filp) {
+    struct aesd_file *file;
     PDEBUG("open");
-    /**
-     * TODO: handle open
-     */
+
+    file = kzalloc(sizeof(*file), GFP_KERNEL);
+    if (!file) {
+        return -ENOMEM;
+    }
+    file->dev = container_of(inode->i_cdev, struct aesd_dev, cdev);
+    file->eof_pos = -1;
+    mutex_init(&file->lock);
+    filp->private_data = file;
     return 0;
 }
 
 int aesd_release(struct inode *inode, struct file *filp) {
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *dev = file->dev;
     PDEBUG("release");
-    /**
-     * TODO: handle release
-     */
+
+    // hand an unterminated write to the device so the next writer completes it
+    if (file->staging.size) {
+        mutex_lock(&dev->lock);
+        if (aesd_staging_reserve(&dev->orphan, dev->orphan.size + file->staging.size) == 0) {
+            memcpy(dev->orphan.buf + dev->orphan.size, file->staging.buf, file->staging.size);
+            dev->orphan.size += file->staging.size;
+        } else {
+            printk(KERN_WARNING "aesdchar: dropping %zu unterminated bytes\n", file->staging.size);
+        }
+        mutex_unlock(&dev->lock);
+    }
+
+    kfree(file->staging.buf);
+    mutex_destroy(&file->lock);
+    kfree(file);
     return 0;
 }
 
+/**
+ * Where a read by @param file at @param pos resumes.  Positions count from the oldest
+ * retained command, so once the buffer is full every write shifts them down, and the
+ * history may not grow at all.  A reader that hit the end before those writes resumes
+ * at the first byte committed since, or at 0 if even that has been evicted.
+ * Caller must hold dev->lock.
+ */
+static loff_t aesd_resume_pos(struct aesd_dev *dev, struct aesd_file *file, loff_t pos) {
+    u64 start = dev->committed - aesd_circular_buffer_size(&dev->buffer);
+
+    if (pos != file->eof_pos || dev->committed == file->eof_mark) {
+        return pos;
+    }
+    file->eof_pos = -1;
+    return file->eof_mark > start ? file->eof_mark - start : 0;
+}
+
 ssize_t aesd_read(struct file *filp, char __user *buf, size_t count,
                 loff_t *f_pos) {
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *dev = file->dev;
+    struct aesd_buffer_entry *entry;
+    size_t entry_offset;
     ssize_t retval = 0;
     PDEBUG("read %zu bytes with offset %lld",count,*f_pos);
-    /**
-     * TODO: handle read
-     */
+
+    if (mutex_lock_interruptible(&dev->lock)) {
+        return -ERESTARTSYS;
+    }
+
+    for (;;) {
+        *f_pos = aesd_resume_pos(dev, file, *f_pos);
+        entry = aesd_circular_buffer_find_entry_offset_for_fpos(&dev->buffer, *f_pos, &entry_offset);
+        if (entry) {
+            break;
+        }
+        file->eof_pos = *f_pos;
+        file->eof_mark = dev->committed;
+        mutex_unlock(&dev->lock);
+
+        if (!aesd_blocking_read) {
+            return 0;
+        }
+        if (filp->f_flags & O_NONBLOCK) {
+            return -EAGAIN;
+        }
+        /* the history need not grow past *f_pos, but every write advances committed */
+        if (wait_event_interruptible(dev->readq, READ_ONCE(dev->committed) != file->eof_mark)) {
+            return -ERESTARTSYS;
+        }
+        if (mutex_lock_interruptible(&dev->lock)) {
+            return -ERESTARTSYS;
+        }
+    }
+
+    count = min(count, entry->size - entry_offset);
+    if (copy_to_user(buf, entry->buffptr + entry_offset, count)) {
+        retval = -EFAULT;
+    } else {
+        *f_pos += count;
+        retval = count;
+    }
+
+    mutex_unlock(&dev->lock);
     return retval;
 }
 
-ssize_t aesd_write(struct file *filp, const char __user *buf, size_t count,
-                loff_t *f_pos) {
-    ssize_t retval = -ENOMEM;
-    PDEBUG("write %zu bytes with offset %lld",count,*f_pos);
-    /**
-     * TODO: handle write
-     */
+/**
+ * Command storage comes from a slab cache per size class, so steady state writes
+ * neither hit the general purpose kmalloc caches nor realloc as they grow.  Commands
+ * larger than the largest class fall back to kmalloc.
+ */
+#define AESD_ENTRY_CLASSES 4
+static const size_t aesd_entry_class_size[AESD_ENTRY_CLASSES] = { 64, 256, 1024, 4096 };
+static const char * const aesd_entry_class_name[AESD_ENTRY_CLASSES] = {
+    "aesdchar_entry_64", "aesdchar_entry_256", "aesdchar_entry_1024", "aesdchar_entry_4096",
+};
+static struct kmem_cache *aesd_entry_cache[AESD_ENTRY_CLASSES];
+
+/**
+ * Smallest staging buffer allocated for partial writes, and the largest kept once
+ * a write completes.  Staging grows geometrically in between.
+ */
+#define AESD_PARTIAL_MIN_CAPACITY 256
+#define AESD_PARTIAL_MAX_RETAINED PAGE_SIZE
+
+static int aesd_entry_class(size_t size) {
+    int class;
+
+    for (class = 0; class < AESD_ENTRY_CLASSES; class++) {
+        if (size <= aesd_entry_class_size[class]) {
+            return class;
+        }
+    }
+    return -1;
+}
+
+static char *aesd_entry_alloc(size_t size) {
+    int class = aesd_entry_class(size);
+
+    if (class < 0) {
+        return kmalloc(size, GFP_KERNEL);
+    }
+    return kmem_cache_alloc(aesd_entry_cache[class], GFP_KERNEL);
+}
+
+static void aesd_entry_free(const char *buffptr, size_t size) {
+    int class = aesd_entry_class(size);
+
+    if (!buffptr) {
+        return;
+    }
+    if (class < 0) {
+        kfree(buffptr);
+    } else {
+        kmem_cache_free(aesd_entry_cache[class], (void *)buffptr);
+    }
+}
+
+static void aesd_entry_caches_destroy(void) {
+    int class;
+
+    for (class = 0; class < AESD_ENTRY_CLASSES; class++) {
+        kmem_cache_destroy(aesd_entry_cache[class]);
+        aesd_entry_cache[class] = NULL;
+    }
+}
+
+static int aesd_entry_caches_create(void) {
+    int class;
+
+    for (class = 0; class < AESD_ENTRY_CLASSES; class++) {
+        aesd_entry_cache[class] = kmem_cache_create(aesd_entry_class_name[class],
+                aesd_entry_class_size[class], 0, 0, NULL);
+        if (!aesd_entry_cache[class]) {
+            aesd_entry_caches_destroy();
+            return -ENOMEM;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Adds @param entry to the history of @param dev, freeing the command it displaces.
+ * Caller must hold dev->lock.
+ */
+static void aesd_add_entry(struct aesd_dev *dev, const struct aesd_buffer_entry *entry) {
+    if (dev->buffer.full) {
+        struct aesd_buffer_entry *oldest = &dev->buffer.entry[dev->buffer.in_offs];
+
+        aesd_entry_free(oldest->buffptr, oldest->size);
+    }
+    aesd_circular_buffer_add_entry(&dev->buffer, entry);
+    WRITE_ONCE(dev->committed, dev->committed + entry->size);
+}
+
+/**
+ * Makes room for at least @param size bytes in @param staging.
+ * Caller must hold the lock protecting @param staging.
+ */
+static int aesd_staging_reserve(struct aesd_staging *staging, size_t size) {
+    size_t capacity;
+    char *buf;
+
+    if (size <= staging->capacity) {
+        return 0;
+    }
+
+    capacity = max_t(size_t, staging->capacity * 2, AESD_PARTIAL_MIN_CAPACITY);
+    capacity = max(capacity, size);
+    buf = krealloc(staging->buf, capacity, GFP_KERNEL);
+    if (!buf) {
+        return -ENOMEM;
+    }
+
+    staging->buf = buf;
+    staging->capacity = capacity;
+    return 0;
+}
+
+/**
+ * Releases the memory of an empty @param staging once it has grown large.
+ * Caller must hold the lock protecting @param staging.
+ */
+static void aesd_staging_trim(struct aesd_staging *staging) {
+    if (staging->size == 0 && staging->capacity > AESD_PARTIAL_MAX_RETAINED) {
+        kfree(staging->buf);
+        staging->buf = NULL;
+        staging->capacity = 0;
+    }
+}
+
+/**
+ * Appends up to @param count bytes from @param from to the staged partial write of @param file.
+ * Once the write completes one or more commands, takes the device lock once to commit them all,
+ * prefixed by any unterminated write left behind by closed files, and wakes readers.
+ * Caller must hold file->lock.
+ * @return the number of bytes accepted, fewer than @param count only if an allocation failed
+ *      part way through, or a negative errno if nothing was accepted.
+ */
+static ssize_t aesd_append(struct aesd_file *file, struct iov_iter *from, size_t count) {
+    struct aesd_staging *staging = &file->staging;
+    struct aesd_dev *dev = file->dev;
+    size_t old_size = staging->size;
+    size_t start = 0; // first byte of staging not yet committed
+    size_t copied;
+    char *newline;
+    int result;
+
+    result = aesd_staging_reserve(staging, old_size + count);
+    if (result) {
+        return result;
+    }
+
+    copied = copy_from_iter(staging->buf + old_size, count, from);
+    if (copied == 0) {
+        return -EFAULT;
+    }
+    staging->size += copied;
+
+    // anything staged before this call is known not to contain a newline
+    newline = memchr(staging->buf + old_size, '\n', copied);
+    if (!newline) {
+        return copied;
+    }
+
+    if (mutex_lock_interruptible(&dev->lock)) {
+        staging->size = old_size;
+        return -ERESTARTSYS;
+    }
+
+    do {
+        struct aesd_buffer_entry entry;
+        size_t size = newline + 1 - (staging->buf + start);
+        size_t prefix = dev->orphan.size;
+        char *buffptr = aesd_entry_alloc(prefix + size);
+
+        if (!buffptr) {
+            // report a short write, dropping what could not be committed
+            staging->size = max(start, old_size);
+            break;
+        }
+
+        if (prefix) {
+            memcpy(buffptr, dev->orphan.buf, prefix);
+            dev->orphan.size = 0;
+        }
+        memcpy(buffptr + prefix, staging->buf + start, size);
+        entry.buffptr = buffptr;
+        entry.size = prefix + size;
+        aesd_add_entry(dev, &entry);
+        start += size;
+    } while ((newline = memchr(staging->buf + start, '\n', staging->size - start)) != NULL);
+
+    if (start) {
+        aesd_staging_trim(&dev->orphan);
+        wake_up_interruptible(&dev->readq);
+    }
+    mutex_unlock(&dev->lock);
+
+    copied = staging->size - old_size;
+    if (start) {
+        staging->size -= start;
+        memmove(staging->buf, staging->buf + start, staging->size);
+        aesd_staging_trim(staging);
+    }
+
+    return copied ? copied : -ENOMEM;
+}
+
+/**
+ * Handles write() as well as writev(), so a vector of many commands is committed
+ * under a single device lock acquisition.
+ */
+static ssize_t aesd_write_iter(struct kiocb *iocb, struct iov_iter *from) {
+    struct aesd_file *file = iocb->ki_filp->private_data;
+    size_t count = iov_iter_count(from);
+    ssize_t retval;
+    PDEBUG("write %zu bytes with offset %lld",count,iocb->ki_pos);
+
+    if (count == 0) {
+        return 0;
+    }
+
+    if (mutex_lock_interruptible(&file->lock)) {
+        return -ERESTARTSYS;
+    }
+    retval = aesd_append(file, from, count);
+    mutex_unlock(&file->lock);
+
+    return retval;
+}
+
+/**
+ * Seeks within the retained history, which is treated as a file of its current total size.
+ */
+static loff_t aesd_llseek(struct file *filp, loff_t off, int whence) {
+    struct aesd_dev *dev = aesd_file_dev(filp);
+    loff_t retval;
+
+    if (mutex_lock_interruptible(&dev->lock)) {
+        return -ERESTARTSYS;
+    }
+    retval = fixed_size_llseek(filp, off, whence, aesd_circular_buffer_size(&dev->buffer));
+    ((struct aesd_file *)filp->private_data)->eof_pos = -1;
+    mutex_unlock(&dev->lock);
+
     return retval;
 }
 
+/**
+ * Moves the file position of @param filp to @param write_cmd_offset bytes into the
+ * @param write_cmd oldest retained command.
+ */
+static long aesd_adjust_file_offset(struct file *filp, unsigned int write_cmd,
+                unsigned int write_cmd_offset) {
+    struct aesd_dev *dev = aesd_file_dev(filp);
+    struct aesd_buffer_entry *entry;
+    size_t entry_fpos;
+    long retval = 0;
+
+    if (mutex_lock_interruptible(&dev->lock)) {
+        return -ERESTARTSYS;
+    }
+
+    entry = aesd_circular_buffer_get_entry(&dev->buffer, write_cmd, &entry_fpos);
+    if (!entry || write_cmd_offset >= entry->size) {
+        retval = -EINVAL;
+    } else {
+        spin_lock(&filp->f_lock);
+        filp->f_pos = entry_fpos + write_cmd_offset;
+        spin_unlock(&filp->f_lock);
+        ((struct aesd_file *)filp->private_data)->eof_pos = -1;
+    }
+
+    mutex_unlock(&dev->lock);
+    return retval;
+}
+
+static long aesd_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned long arg) {
+    struct aesd_seekto seekto;
+    PDEBUG("ioctl %u", cmd);
+
+    if (_IOC_TYPE(cmd) != AESD_IOC_MAGIC || _IOC_NR(cmd) > AESDCHAR_IOC_MAXNR) {
+        return -ENOTTY;
+    }
+
+    switch (cmd) {
+    case AESDCHAR_IOCSEEKTO:
+        if (copy_from_user(&seekto, (const void __user *)arg, sizeof(seekto))) {
+            return -EFAULT;
+        }
+        return aesd_adjust_file_offset(filp, seekto.write_cmd, seekto.write_cmd_offset);
+    default:
+        return -ENOTTY;
+    }
+}
+
+/**
+ * Readable whenever the history extends past the file position, or anything was
+ * committed since a read at this position hit the end; always writable.
+ */
+static __poll_t aesd_poll(struct file *filp, poll_table *wait) {
+    struct aesd_file *file = filp->private_data;
+    struct aesd_dev *dev = file->dev;
+    __poll_t mask = EPOLLOUT | EPOLLWRNORM;
+
+    poll_wait(filp, &dev->readq, wait);
+
+    mutex_lock(&dev->lock);
+    if (filp->f_pos < aesd_circular_buffer_size(&dev->buffer) ||
+        (filp->f_pos == file->eof_pos && dev->committed != file->eof_mark)) {
+        mask |= EPOLLIN | EPOLLRDNORM;
+    }
+    mutex_unlock(&dev->lock);
+
+    return mask;
+}
+
+/**
+ * A snapshot of the history handed out by aesd_mmap.  Shared by every vma
+ * split or copied from the original mapping and freed with the last of them.
+ */
+struct aesd_mmap_view {
+    struct kref ref;
+    void *data;
+};
+
+static void aesd_mmap_view_free(struct kref *ref) {
+    struct aesd_mmap_view *view = container_of(ref, struct aesd_mmap_view, ref);
+
+    vfree(view->data);
+    kfree(view);
+}
+
+static void aesd_vma_open(struct vm_area_struct *vma) {
+    struct aesd_mmap_view *view = vma->vm_private_data;
+
+    kref_get(&view->ref);
+}
+
+static void aesd_vma_close(struct vm_area_struct *vma) {
+    struct aesd_mmap_view *view = vma->vm_private_data;
+
+    kref_put(&view->ref, aesd_mmap_view_free);
+}
+
+static const struct vm_operations_struct aesd_vm_ops = {
+    .open =     aesd_vma_open,
+    .close =    aesd_vma_close,
+};
+
+/**
+ * Maps the retained write commands, oldest first, as one contiguous read only region.
+ * The history is copied once into page aligned vmalloc memory which is then mapped
+ * directly into the caller, so scanning it needs no further syscalls or copies.
+ * The view reflects the history at mmap time; bytes past the end of it read as zero.
+ * The mapping may not extend beyond the page holding the last retained byte.
+ */
+static int aesd_mmap(struct file *filp, struct vm_area_struct *vma) {
+    struct aesd_dev *dev = aesd_file_dev(filp);
+    unsigned long len = vma->vm_end - vma->vm_start;
+    struct aesd_buffer_entry *entry;
+    struct aesd_mmap_view *view;
+    size_t history;
+    size_t copied = 0;
+    size_t i;
+    int result;
+    PDEBUG("mmap %lu bytes", len);
+
+    if (vma->vm_flags & VM_WRITE) {
+        return -EACCES;
+    }
+    if (vma->vm_pgoff != 0) {
+        return -EINVAL;
+    }
+
+    view = kmalloc(sizeof(*view), GFP_KERNEL);
+    if (!view) {
+        return -ENOMEM;
+    }
+    kref_init(&view->ref);
+    view->data = NULL;
+
+    if (mutex_lock_interruptible(&dev->lock)) {
+        result = -ERESTARTSYS;
+        goto fail;
+    }
+    /* the size is only stable under the lock, so check and copy while holding it */
+    history = aesd_circular_buffer_size(&dev->buffer);
+    if (len > PAGE_ALIGN(history)) {
+        result = -EINVAL;
+        goto fail_unlock;
+    }
+    view->data = vmalloc_user(len);
+    if (!view->data) {
+        result = -ENOMEM;
+        goto fail_unlock;
+    }
+    history = min_t(size_t, history, len);
+    for (i = 0; i < aesd_circular_buffer_entry_count(&dev->buffer) && copied < history; i++) {
+        size_t size;
+
+        entry = &dev->buffer.entry[(dev->buffer.out_offs + i) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+        size = min_t(size_t, entry->size, history - copied);
+        memcpy(view->data + copied, entry->buffptr, size);
+        copied += size;
+    }
+    mutex_unlock(&dev->lock);
+
+    result = remap_vmalloc_range(vma, view->data, 0);
+    if (result) {
+        goto fail;
+    }
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+    vm_flags_clear(vma, VM_MAYWRITE);
+#else
+    vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+    vma->vm_private_data = view;
+    vma->vm_ops = &aesd_vm_ops;
+    return 0;
+
+fail_unlock:
+    mutex_unlock(&dev->lock);
+fail:
+    vfree(view->data);
+    kfree(view);
+    return result;
+}
+
 struct file_operations aesd_fops = {
     .owner =    THIS_MODULE,
+    .llseek =   aesd_llseek,
     .read =     aesd_read,
-    .write =    aesd_write,
+    .write_iter = aesd_write_iter,
+    .mmap =     aesd_mmap,
+    .poll =     aesd_poll,
+    .unlocked_ioctl = aesd_unlocked_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
     .open =     aesd_open,
     .release =  aesd_release,
 };
 
-static int aesd_setup_cdev(struct aesd_dev *dev) {
-    int err, devno = MKDEV(aesd_major, aesd_minor);
+static int aesd_setup_cdev(struct aesd_dev *dev, unsigned int index) {
+    int err, devno = MKDEV(aesd_major, aesd_minor + index);
 
     cdev_init(&dev->cdev, &aesd_fops);
     dev->cdev.owner = THIS_MODULE;
     dev->cdev.ops = &aesd_fops;
     err = cdev_add (&dev->cdev, devno, 1);
     if (err) {
-        printk(KERN_ERR "Error %d adding aesd cdev", err);
+        printk(KERN_ERR "Error %d adding aesd cdev %u", err, index);
     }
     return err;
 }
 
+static void aesd_dev_init(struct aesd_dev *dev) {
+    mutex_init(&dev->lock);
+    init_waitqueue_head(&dev->readq);
+    aesd_circular_buffer_init(&dev->buffer);
+}
 
+static void aesd_dev_destroy(struct aesd_dev *dev) {
+    struct aesd_buffer_entry *entry;
+    aesd_cb_index_t index;
+
+    AESD_CIRCULAR_BUFFER_FOREACH(entry, &dev->buffer, index) {
+        aesd_entry_free(entry->buffptr, entry->size);
+    }
+    kfree(dev->orphan.buf);
+    mutex_destroy(&dev->lock);
+}
 
 int aesd_init_module(void) {
     dev_t dev = 0;
+    unsigned int i;
     int result;
-    result = alloc_chrdev_region(&dev, aesd_minor, 1,
+
+    if (aesd_nr_devs == 0) {
+        return -EINVAL;
+    }
+
+    result = alloc_chrdev_region(&dev, aesd_minor, aesd_nr_devs,
             "aesdchar");
     aesd_major = MAJOR(dev);
     if (result < 0) {
         printk(KERN_WARNING "Can't get major %d\n", aesd_major);
         return result;
     }
-    memset(&aesd_device,0,sizeof(struct aesd_dev));
+    result = aesd_entry_caches_create();
+    if (result) {
+        goto fail_caches;
+    }
 
-    /**
-     * TODO: initialize the AESD specific portion of the device
-     */
+    aesd_devices = kcalloc(aesd_nr_devs, sizeof(struct aesd_dev), GFP_KERNEL);
+    if (!aesd_devices) {
+        result = -ENOMEM;
+        goto fail_devices;
+    }
 
-    result = aesd_setup_cdev(&aesd_device);
+    for (i = 0; i < aesd_nr_devs; i++) {
+        aesd_dev_init(&aesd_devices[i]);
+        result = aesd_setup_cdev(&aesd_devices[i], i);
+        if (result) {
+            goto fail_cdev;
+        }
+    }
+    return 0;
 
-    if( result ) {
-        unregister_chrdev_region(dev, 1);
+fail_cdev:
+    aesd_dev_destroy(&aesd_devices[i]);
+    while (i--) {
+        cdev_del(&aesd_devices[i].cdev);
+        aesd_dev_destroy(&aesd_devices[i]);
     }
+    kfree(aesd_devices);
+fail_devices:
+    aesd_entry_caches_destroy();
+fail_caches:
+    unregister_chrdev_region(dev, aesd_nr_devs);
     return result;
-
 }
 
 void aesd_cleanup_module(void) {
     dev_t devno = MKDEV(aesd_major, aesd_minor);
+    unsigned int i;
 
-    cdev_del(&aesd_device.cdev);
-
-    /**
-     * TODO: cleanup AESD specific poritions here as necessary
-     */
+    for (i = 0; i < aesd_nr_devs; i++) {
+        cdev_del(&aesd_devices[i].cdev);
+        aesd_dev_destroy(&aesd_devices[i]);
+    }
+    kfree(aesd_devices);
+    aesd_entry_caches_destroy();
 
-    unregister_chrdev_region(devno, 1);
+    unregister_chrdev_region(devno, aesd_nr_devs);
 }
 
 
@@ -0,0 +1,84 @@
+/**
+ * @file aesdchar-mmap-test.c
+ * @brief Verifies the mmap view of /dev/aesdchar matches what read() returns.
+ *
+ * Usage: aesdchar-mmap-test [device]
+ * Writes a few commands, reads the whole history back with read(), then maps the
+ * device and compares.  Also checks that writable mappings and mappings longer
+ * than the history are refused.
+ */
+
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define DEFAULT_DEVICE "/dev/aesdchar"
+#define HISTORY_MAX (1024 * 1024)
+
+int main(int argc, char **argv)
+{
+    const char *device = argc > 1 ? argv[1] : DEFAULT_DEVICE;
+    static char history[HISTORY_MAX];
+    size_t history_size = 0;
+    ssize_t n;
+    size_t oversize;
+    long page = sysconf(_SC_PAGESIZE);
+    char *view;
+    int fd;
+
+    fd = open(device, O_RDWR);
+    if (fd < 0) {
+        fprintf(stderr, "open %s: %s\n", device, strerror(errno));
+        return 1;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        char cmd[32];
+        int len = snprintf(cmd, sizeof(cmd), "mmap test %d\n", i);
+        if (write(fd, cmd, len) != len) {
+            fprintf(stderr, "write: %s\n", strerror(errno));
+            return 1;
+        }
+    }
+
+    while ((n = read(fd, history + history_size, HISTORY_MAX - history_size)) > 0) {
+        history_size += n;
+    }
+    if (n < 0) {
+        fprintf(stderr, "read: %s\n", strerror(errno));
+        return 1;
+    }
+
+    if (mmap(NULL, history_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) != MAP_FAILED) {
+        fprintf(stderr, "FAIL: writable mapping was allowed\n");
+        return 1;
+    }
+
+    oversize = (history_size + page - 1) / page * page + page;
+    if (mmap(NULL, oversize, PROT_READ, MAP_SHARED, fd, 0) != MAP_FAILED || errno != EINVAL) {
+        fprintf(stderr, "FAIL: %zu byte mapping of a %zu byte history was not refused with EINVAL\n",
+                oversize, history_size);
+        return 1;
+    }
+
+    view = mmap(NULL, history_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (view == MAP_FAILED) {
+        fprintf(stderr, "mmap: %s\n", strerror(errno));
+        return 1;
+    }
+
+    if (memcmp(view, history, history_size) != 0) {
+        fprintf(stderr, "FAIL: mmap view differs from read() output\n");
+        return 1;
+    }
+
+    munmap(view, history_size);
+    close(fd);
+    printf("PASS: %zu bytes match\n", history_size);
+    return 0;
+}
@@ -0,0 +1,111 @@
+/**
+ * @file aesdchar-writev-bench.c
+ * @brief Compares committing commands to /dev/aesdchar with one write() per command
+ * against batching them into writev() calls.
+ *
+ * Usage: aesdchar-writev-bench [device] [commands] [command size]
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_DEVICE "/dev/aesdchar"
+#define DEFAULT_COMMANDS 100000
+#define DEFAULT_COMMAND_SIZE 64
+#define BATCH IOV_MAX
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int bench_write(int fd, const char *cmd, size_t size, long commands)
+{
+    for (long i = 0; i < commands; i++) {
+        if (write(fd, cmd, size) != (ssize_t)size) {
+            fprintf(stderr, "write: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int bench_writev(int fd, const char *cmd, size_t size, long commands)
+{
+    struct iovec iov[BATCH];
+
+    for (int i = 0; i < BATCH; i++) {
+        iov[i].iov_base = (void *)cmd;
+        iov[i].iov_len = size;
+    }
+
+    for (long done = 0; done < commands; ) {
+        int batch = commands - done < BATCH ? commands - done : BATCH;
+        if (writev(fd, iov, batch) != (ssize_t)(batch * size)) {
+            fprintf(stderr, "writev: %s\n", strerror(errno));
+            return -1;
+        }
+        done += batch;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *device = argc > 1 ? argv[1] : DEFAULT_DEVICE;
+    long commands = argc > 2 ? atol(argv[2]) : DEFAULT_COMMANDS;
+    size_t size = argc > 3 ? (size_t)atol(argv[3]) : DEFAULT_COMMAND_SIZE;
+    double start, write_sec, writev_sec;
+    char *cmd;
+    int fd;
+
+    if (commands <= 0 || size == 0) {
+        fprintf(stderr, "usage: %s [device] [commands] [command size]\n", argv[0]);
+        return 1;
+    }
+
+    cmd = malloc(size);
+    if (cmd == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    memset(cmd, 'x', size - 1);
+    cmd[size - 1] = '\n';
+
+    fd = open(device, O_WRONLY);
+    if (fd < 0) {
+        fprintf(stderr, "open %s: %s\n", device, strerror(errno));
+        return 1;
+    }
+
+    start = now_sec();
+    if (bench_write(fd, cmd, size, commands) < 0) {
+        return 1;
+    }
+    write_sec = now_sec() - start;
+
+    start = now_sec();
+    if (bench_writev(fd, cmd, size, commands) < 0) {
+        return 1;
+    }
+    writev_sec = now_sec() - start;
+
+    printf("%ld commands of %zu bytes\n", commands, size);
+    printf("write()  per command: %10.0f commands/s\n", commands / write_sec);
+    printf("writev() %4d/batch:  %10.0f commands/s  (%.1fx)\n", BATCH,
+            commands / writev_sec, write_sec / writev_sec);
+
+    close(fd);
+    free(cmd);
+    return 0;
+}
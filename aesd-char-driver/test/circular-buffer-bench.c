@@ -0,0 +1,113 @@
+/**
+ * @file circular-buffer-bench.c
+ * @brief Compares fpos lookups through the entry_start offset index against the original
+ * linear scan over the interleaved buffptr/size entries.
+ *
+ * Build with AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED set to the capacity under test,
+ * see the Makefile in this directory.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../aesd-circular-buffer.h"
+
+#define LOOKUPS 2000000
+#define MAX_ENTRY_SIZE 128
+
+static char payload[MAX_ENTRY_SIZE];
+static volatile size_t sink;
+
+/**
+ * The lookup as it was before entry_start existed: walk every entry from out_offs,
+ * touching each buffptr/size pair until the offset is covered.
+ */
+static struct aesd_buffer_entry *linear_find(struct aesd_circular_buffer *buffer,
+            size_t char_offset, size_t *entry_offset_byte_rtn)
+{
+    size_t bytes_seen = 0;
+
+    for (size_t i = 0; i < AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED; i++) {
+        struct aesd_buffer_entry *entry =
+            &buffer->entry[(i + buffer->out_offs) % AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED];
+
+        if (char_offset >= bytes_seen && char_offset < bytes_seen + entry->size) {
+            *entry_offset_byte_rtn = char_offset - bytes_seen;
+            return entry;
+        }
+        bytes_seen += entry->size;
+    }
+
+    return NULL;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(void)
+{
+    struct aesd_circular_buffer *buffer = aligned_alloc(64,
+            (sizeof(*buffer) + 63) & ~(size_t)63);
+    size_t *offsets = malloc(LOOKUPS * sizeof(*offsets));
+    size_t total, rtn;
+    double start, indexed_ns, linear_ns;
+
+    if (buffer == NULL || offsets == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    srand(1);
+    aesd_circular_buffer_init(buffer);
+    // wrap around once so out_offs is not zero
+    for (size_t i = 0; i < AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED * 3 / 2; i++) {
+        struct aesd_buffer_entry entry = {
+            .buffptr = payload,
+            .size = 1 + rand() % MAX_ENTRY_SIZE,
+        };
+        aesd_circular_buffer_add_entry(buffer, &entry);
+    }
+
+    total = buffer->end_offs - buffer->entry_start[buffer->out_offs];
+    for (size_t i = 0; i < LOOKUPS; i++) {
+        offsets[i] = ((size_t)rand() * RAND_MAX + rand()) % total;
+    }
+
+    // both must agree before timing means anything
+    for (size_t i = 0; i < LOOKUPS; i += LOOKUPS / 1000) {
+        size_t a = 0, b = 0;
+        if (aesd_circular_buffer_find_entry_offset_for_fpos(buffer, offsets[i], &a) !=
+                linear_find(buffer, offsets[i], &b) || a != b) {
+            fprintf(stderr, "lookup mismatch at offset %zu\n", offsets[i]);
+            return 1;
+        }
+    }
+
+    start = now_ns();
+    for (size_t i = 0; i < LOOKUPS; i++) {
+        sink += (size_t)aesd_circular_buffer_find_entry_offset_for_fpos(buffer, offsets[i], &rtn);
+    }
+    indexed_ns = (now_ns() - start) / LOOKUPS;
+
+    // the linear scan is O(n), keep the 16k case from running for minutes
+    size_t linear_lookups = LOOKUPS / (AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED / 64 + 1);
+    start = now_ns();
+    for (size_t i = 0; i < linear_lookups; i++) {
+        sink += (size_t)linear_find(buffer, offsets[i], &rtn);
+    }
+    linear_ns = (now_ns() - start) / linear_lookups;
+
+    printf("entries %6d  retained %9zu bytes  indexed %8.1f ns/lookup  linear %10.1f ns/lookup  speedup %.1fx\n",
+            AESDCHAR_MAX_WRITE_OPERATIONS_SUPPORTED, total, indexed_ns, linear_ns,
+            linear_ns / indexed_ns);
+
+    free(offsets);
+    free(buffer);
+    return 0;
+}
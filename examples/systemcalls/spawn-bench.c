@@ -0,0 +1,103 @@
+/**
+ * @file spawn-bench.c
+ * @brief Measures the latency of starting and reaping /bin/true through do_exec(), which
+ * uses posix_spawn(), against the fork()/execv()/waitpid() sequence it replaced, as the
+ * resident set of the parent grows.
+ *
+ * Usage: spawn-bench [iterations]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "systemcalls.h"
+
+#define DEFAULT_ITERATIONS 200
+#define BENCH_COMMAND "/bin/true"
+
+static const size_t rss_mb[] = { 0, 64, 256, 1024 };
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static bool fork_exec(void)
+{
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == -1) {
+        return false;
+    }
+    if (pid == 0) {
+        execl(BENCH_COMMAND, BENCH_COMMAND, (char *)NULL);
+        exit(127);
+    }
+
+    int w_status;
+    return waitpid(pid, &w_status, 0) == pid && WIFEXITED(w_status) && WEXITSTATUS(w_status) == 0;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+    char *ballast = NULL;
+
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    // do_exec reports progress on stdout, keep the results on stderr readable
+    if (freopen("/dev/null", "w", stdout) == NULL) {
+        perror("freopen");
+        return 1;
+    }
+
+    fprintf(stderr, "%8s %16s %16s\n", "rss MB", "fork+exec us", "posix_spawn us");
+    for (size_t i = 0; i < sizeof(rss_mb) / sizeof(rss_mb[0]); i++) {
+        size_t bytes = rss_mb[i] << 20;
+        double start, fork_us, spawn_us;
+
+        free(ballast);
+        ballast = bytes ? malloc(bytes) : NULL;
+        if (bytes && ballast == NULL) {
+            fprintf(stderr, "could not allocate %zu MB\n", rss_mb[i]);
+            return 1;
+        }
+        // touch every page so it is resident and mapped in our page tables
+        if (ballast) {
+            memset(ballast, 1, bytes);
+        }
+
+        start = now_us();
+        for (int n = 0; n < iterations; n++) {
+            if (!fork_exec()) {
+                fprintf(stderr, "fork+exec of %s failed\n", BENCH_COMMAND);
+                return 1;
+            }
+        }
+        fork_us = (now_us() - start) / iterations;
+
+        start = now_us();
+        for (int n = 0; n < iterations; n++) {
+            if (!do_exec(1, BENCH_COMMAND)) {
+                fprintf(stderr, "do_exec of %s failed\n", BENCH_COMMAND);
+                return 1;
+            }
+        }
+        spawn_us = (now_us() - start) / iterations;
+
+        fprintf(stderr, "%8zu %16.1f %16.1f\n", rss_mb[i], fork_us, spawn_us);
+    }
+
+    free(ballast);
+    return 0;
+}
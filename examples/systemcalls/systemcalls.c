@@ -1,3 +1,4 @@
+#define _GNU_SOURCE // pipe2
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/wait.h>
@@ -5,9 +6,72 @@
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
+#include <spawn.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
 
 #include "systemcalls.h"
 
+// captured output grows by at least this much at a time
+#define EXEC_CAPTURE_CHUNK 4096
+#define EXEC_BATCH_EVENTS 32
+// how often exits are checked when pidfd_open is unavailable
+#define EXEC_BATCH_POLL_MS 10
+
+extern char **environ;
+
+/**
+ * Starts @param command with posix_spawn(), applying @param file_actions in the child.
+ * posix_spawn() starts the child with vfork/CLONE_VM semantics, so unlike fork() its
+ * cost does not grow with the page tables of a large parent.
+ * @return true if the child was started, its pid stored in @param pid
+ */
+static bool spawn_command(pid_t *pid, char * const command[],
+        const posix_spawn_file_actions_t *file_actions)
+{
+    // the child shares no stdio buffers with us, this only keeps our output ahead of its output
+    fflush(NULL);
+
+    int spawn_err = posix_spawn(pid, command[0], file_actions, NULL, command, environ);
+    if (spawn_err != 0) {
+        printf("running %s, posix_spawn failed: %s\n", command[0], strerror(spawn_err));
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Runs @param command as for spawn_command() and waits for it to finish.
+ * @return true if the command was started and exited with status 0
+ */
+static bool spawn_and_wait(char * const command[], const posix_spawn_file_actions_t *file_actions)
+{
+    pid_t pid;
+    if (!spawn_command(&pid, command, file_actions)) {
+        return false;
+    }
+
+    printf("waiting for pid %d\n", pid);
+
+    int w_status;
+    pid_t w_pid = waitpid(pid, &w_status, 0);
+    if (w_pid == -1) {
+        printf("wait failed: %s\n", strerror(errno));
+        return false;
+    }
+
+    if (WIFEXITED(w_status) == true && WEXITSTATUS(w_status) == 0) {
+        printf("wait ended ok for %d\n", pid);
+        return true;
+    }
+
+    return false;
+}
+
 /**
  * @param cmd the command to execute with system()
  * @return true if the command in @param cmd was executed
@@ -72,42 +136,7 @@ bool do_exec(int count, ...)
  *   as second argument to the execv() command.
  *
 */
-    fflush(NULL);
-    pid_t pid = fork();
-    if (pid == -1) {
-        printf("fork failed: %s\n", strerror(errno));
-        return false;
-    }
-
-    if (pid == 0) {
-        // in child
-        int exec_res = execv(command[0], command);
-        if (exec_res == -1) {
-            printf("running %s, execv failed: %s\n", command[0], strerror(errno));
-        }
-        exit(127); // execv only returns on error
-    }
-
-    if (pid > 0) {
-        // in parent
-        printf("waiting for pid %d\n", pid);
-
-        int w_status;
-        pid_t w_pid = waitpid(pid, &w_status, 0);
-        if (w_pid == -1) {
-            printf("wait failed: %s\n", strerror(errno));
-            return false;
-        }
-
-        if (WIFEXITED(w_status) == true && WEXITSTATUS(w_status) == 0) {
-            printf("wait ended ok for %d\n", pid);
-            return true;
-        }
-
-        return false;
-    }
-
-    return true;
+    return spawn_and_wait(command, NULL);
 }
 
 /**
@@ -135,46 +164,628 @@ bool do_exec_redirect(const char *outputfile, int count, ...)
  *   The rest of the behaviour is same as do_exec()
  *
 */
-    fflush(NULL);
+    posix_spawn_file_actions_t file_actions;
+    if (posix_spawn_file_actions_init(&file_actions) != 0) {
+        return false;
+    }
+
+    bool ok = false;
+    if (posix_spawn_file_actions_addopen(&file_actions, STDOUT_FILENO, outputfile,
+                O_WRONLY|O_TRUNC|O_CREAT, 0644) == 0) {
+        ok = spawn_and_wait(command, &file_actions);
+    }
+
+    posix_spawn_file_actions_destroy(&file_actions);
+    return ok;
+}
 
+/**
+ * Where drain_fd() puts the output it reads from one stream of a command
+ */
+struct output_sink {
+    char *data;          // NUL terminated buffered output, NULL until something arrives
+    size_t len;
+    size_t capacity;
+    size_t limit;        // most bytes to buffer, 0 for no limit
+    bool truncated;      // output past limit, or which could not be buffered, was discarded
+    exec_output_cb callback; // if set, output is passed here instead of buffered
+    void *callback_arg;
+    int stream;
+};
+
+enum drain_result { DRAIN_AGAIN, DRAIN_EOF, DRAIN_STOP };
 
-    pid_t pid = fork();
-    if (pid == -1) {
-        printf("fork failed: %s\n", strerror(errno));
+/**
+ * Reads whatever non blocking @param fd has available into @param sink.
+ * @return DRAIN_AGAIN once @param fd has no more data for now, DRAIN_EOF at end of file or
+ *   on error, DRAIN_STOP if the sink callback asked for the command to be stopped
+ */
+static enum drain_result drain_fd(int fd, struct output_sink *sink)
+{
+    char chunk[EXEC_CAPTURE_CHUNK];
+
+    while (true) {
+        ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1 && errno == EAGAIN) {
+            return DRAIN_AGAIN;
+        }
+        if (n <= 0) {
+            return DRAIN_EOF;
+        }
+
+        if (sink->callback != NULL) {
+            if (!sink->callback(sink->stream, chunk, n, sink->callback_arg)) {
+                return DRAIN_STOP;
+            }
+            continue;
+        }
+
+        // keep draining past the limit so the command never blocks on a full pipe
+        size_t keep = n;
+        if (sink->limit && sink->len + keep > sink->limit) {
+            keep = sink->limit - sink->len;
+            sink->truncated = true;
+        }
+        if (keep == 0) {
+            continue;
+        }
+
+        if (sink->len + keep + 1 > sink->capacity) {
+            size_t new_capacity = sink->capacity ? sink->capacity * 2 : EXEC_CAPTURE_CHUNK + 1;
+            if (new_capacity < sink->len + keep + 1) {
+                new_capacity = sink->len + keep + 1;
+            }
+            char *grown = realloc(sink->data, new_capacity);
+            if (grown == NULL) {
+                sink->truncated = true;
+                continue;
+            }
+            sink->data = grown;
+            sink->capacity = new_capacity;
+        }
+
+        memcpy(sink->data + sink->len, chunk, keep);
+        sink->len += keep;
+        sink->data[sink->len] = '\0';
+    }
+}
+
+/**
+ * Creates a pipe for capturing output of a command.  Both ends are O_CLOEXEC, keeping them out
+ * of other commands started meanwhile so EOF arrives when this one exits, and only the read end
+ * is non blocking.
+ */
+static int capture_pipe(int pipe_fds[2])
+{
+    if (pipe2(pipe_fds, O_CLOEXEC) == -1) {
+        return -1;
+    }
+    if (fcntl(pipe_fds[0], F_SETFL, O_NONBLOCK) == -1) {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        pipe_fds[0] = pipe_fds[1] = -1;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @return a pidfd for @param pid, or -1 where pidfd_open is not available, in which
+ * case the caller checks for the exit with waitpid every EXEC_BATCH_POLL_MS
+ */
+static int open_pidfd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+enum exec_job_state { EXEC_JOB_PENDING, EXEC_JOB_RUNNING, EXEC_JOB_DONE };
+
+struct exec_job {
+    struct exec_cmd *cmd;
+    enum exec_job_state state;
+    pid_t pid;
+    int pidfd;           // -1 once reaped, or if pidfd_open is not supported
+    int out_fd;          // read end of the stdout pipe, -1 if not capturing or at EOF
+    struct output_sink out;
+    bool exited;
+};
+
+// epoll user data: job index shifted left, low bit set for the stdout pipe
+#define EXEC_EV_PIDFD 0
+#define EXEC_EV_STDOUT 1
+
+/**
+ * Starts the command of @param job, registering its pidfd and stdout pipe with @param epfd.
+ * @return false if it could not be started, in which case the job is already finished
+ */
+static bool exec_job_start(struct exec_job *job, uint64_t index, int epfd)
+{
+    posix_spawn_file_actions_t file_actions;
+    int pipe_fds[2] = { -1, -1 };
+    struct epoll_event ev;
+    bool started = false;
+
+    job->pidfd = -1;
+    job->out_fd = -1;
+    job->exited = false;
+    job->cmd->status = -1;
+
+    if (posix_spawn_file_actions_init(&file_actions) != 0) {
         return false;
     }
 
-    if (pid == 0) {
-        // in child
-        int fd = open(outputfile, O_WRONLY|O_TRUNC|O_CREAT, 0644);
-        dup2(fd, 1);
-        close(fd);
+    if (job->cmd->capture_stdout) {
+        if (capture_pipe(pipe_fds) == -1 ||
+                posix_spawn_file_actions_adddup2(&file_actions, pipe_fds[1], STDOUT_FILENO) != 0) {
+            goto out;
+        }
+    }
+
+    started = spawn_command(&job->pid, job->cmd->argv, &file_actions);
+    if (!started) {
+        goto out;
+    }
+
+    job->pidfd = open_pidfd(job->pid);
+    if (job->pidfd >= 0) {
+        ev.events = EPOLLIN;
+        ev.data.u64 = index << 1 | EXEC_EV_PIDFD;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, job->pidfd, &ev);
+    }
+
+    if (job->cmd->capture_stdout) {
+        job->out_fd = pipe_fds[0];
+        pipe_fds[0] = -1;
+        ev.events = EPOLLIN;
+        ev.data.u64 = index << 1 | EXEC_EV_STDOUT;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, job->out_fd, &ev);
+    }
+
+out:
+    if (pipe_fds[0] != -1) {
+        close(pipe_fds[0]);
+    }
+    if (pipe_fds[1] != -1) {
+        close(pipe_fds[1]);
+    }
+    posix_spawn_file_actions_destroy(&file_actions);
+    return started;
+}
+
+/**
+ * Reaps @param job if it has exited, without blocking.
+ */
+static void exec_job_reap(struct exec_job *job)
+{
+    int w_status;
+
+    if (job->exited) {
+        return;
+    }
+
+    pid_t w_pid = waitpid(job->pid, &w_status, WNOHANG);
+    if (w_pid == 0) {
+        return;
+    }
+
+    job->cmd->status = w_pid == job->pid ? w_status : -1;
+    job->exited = true;
+    if (job->pidfd >= 0) {
+        close(job->pidfd);
+        job->pidfd = -1;
+    }
+}
+
+/**
+ * Kills and reaps the running @param job and discards its output, for when the batch cannot
+ * go on waiting for it.
+ */
+static void exec_job_abandon(struct exec_job *job)
+{
+    int w_status;
 
-        int exec_res = execv(command[0], command);
-        if (exec_res == -1) {
-            printf("running %s, execv failed: %s\n", command[0], strerror(errno));
+    if (!job->exited) {
+        kill(job->pid, SIGKILL);
+        while (waitpid(job->pid, &w_status, 0) == -1 && errno == EINTR) {
         }
-        exit(127); // execv only returns on error
+        job->exited = true;
     }
+    if (job->pidfd >= 0) {
+        close(job->pidfd);
+        job->pidfd = -1;
+    }
+    if (job->out_fd >= 0) {
+        close(job->out_fd);
+        job->out_fd = -1;
+    }
+    free(job->out.data);
+    job->out.data = NULL;
+    job->cmd->status = -1;
+    job->state = EXEC_JOB_DONE;
+}
 
-    if (pid > 0) {
-        // in parent
-        printf("waiting for pid %d\n", pid);
+bool do_exec_batch(struct exec_cmd *cmds, size_t count, size_t max_parallel)
+{
+    struct epoll_event events[EXEC_BATCH_EVENTS];
+    struct exec_job *jobs;
+    size_t next = 0, running = 0, finished = 0;
+    bool all_ok = true;
 
-        int w_status;
-        pid_t w_pid = waitpid(pid, &w_status, 0);
-        if (w_pid == -1) {
-            printf("wait failed: %s\n", strerror(errno));
+    for (size_t i = 0; i < count; i++) {
+        cmds[i].status = -1;
+        cmds[i].output = NULL;
+        cmds[i].output_len = 0;
+    }
+    if (count == 0) {
+        return true;
+    }
+
+    if (max_parallel == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        max_parallel = cpus > 0 ? cpus : 1;
+    }
+
+    jobs = calloc(count, sizeof(*jobs));
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (jobs == NULL || epfd == -1) {
+        printf("could not set up batch: %s\n", strerror(errno));
+        free(jobs);
+        if (epfd != -1) {
+            close(epfd);
+        }
+        return false;
+    }
+
+    while (finished < count) {
+        while (running < max_parallel && next < count) {
+            jobs[next].cmd = &cmds[next];
+            if (exec_job_start(&jobs[next], next, epfd)) {
+                jobs[next].state = EXEC_JOB_RUNNING;
+                running++;
+            } else {
+                jobs[next].state = EXEC_JOB_DONE;
+                finished++;
+                all_ok = false;
+            }
+            next++;
+        }
+
+        if (running == 0) {
+            continue;
+        }
+
+        // without a pidfd the exit of a job can only be noticed by checking periodically
+        bool polling = false;
+        for (size_t i = 0; i < next; i++) {
+            if (jobs[i].state == EXEC_JOB_RUNNING && jobs[i].pidfd < 0 && !jobs[i].exited) {
+                polling = true;
+            }
+        }
+
+        int n = epoll_wait(epfd, events, EXEC_BATCH_EVENTS, polling ? EXEC_BATCH_POLL_MS : -1);
+        if (n == -1 && errno != EINTR) {
+            printf("epoll_wait failed: %s\n", strerror(errno));
+            for (size_t i = 0; i < next; i++) {
+                if (jobs[i].state == EXEC_JOB_RUNNING) {
+                    exec_job_abandon(&jobs[i]);
+                }
+            }
+            close(epfd);
+            free(jobs);
             return false;
         }
 
-        if (WIFEXITED(w_status) == true && WEXITSTATUS(w_status) == 0) {
-            printf("wait ended ok for %d\n", pid);
-            return true;
+        for (int e = 0; e < n; e++) {
+            struct exec_job *job = &jobs[events[e].data.u64 >> 1];
+
+            if ((events[e].data.u64 & 1) == EXEC_EV_STDOUT) {
+                if (drain_fd(job->out_fd, &job->out) != DRAIN_AGAIN) {
+                    close(job->out_fd);
+                    job->out_fd = -1;
+                }
+            } else {
+                exec_job_reap(job);
+            }
         }
 
+        // a job is done once it has exited and its output is drained
+        for (size_t i = 0; i < next; i++) {
+            struct exec_job *job = &jobs[i];
+
+            if (job->state != EXEC_JOB_RUNNING) {
+                continue;
+            }
+            if (polling) {
+                exec_job_reap(job);
+            }
+            if (job->exited && job->out_fd < 0) {
+                if (!(WIFEXITED(job->cmd->status) && WEXITSTATUS(job->cmd->status) == 0)) {
+                    all_ok = false;
+                }
+                job->cmd->output = job->out.data;
+                job->cmd->output_len = job->out.len;
+                job->state = EXEC_JOB_DONE;
+                running--;
+                finished++;
+            }
+        }
+    }
+
+    close(epfd);
+    free(jobs);
+    return all_ok && finished == count;
+}
+
+bool do_exec_pipeline(char * const *stages[], size_t nstages, int out_fd, int *statuses)
+{
+    int (*pipes)[2] = NULL;
+    pid_t *pids;
+    bool all_ok = true;
+    size_t started = 0;
+
+    if (nstages == 0) {
         return false;
     }
 
-    return false;
+    pids = calloc(nstages, sizeof(*pids));
+    if (nstages > 1) {
+        pipes = calloc(nstages - 1, sizeof(*pipes));
+    }
+    if (pids == NULL || (nstages > 1 && pipes == NULL)) {
+        free(pids);
+        free(pipes);
+        return false;
+    }
+
+    // O_CLOEXEC so each stage only holds the two ends dup'd onto its stdin and stdout
+    size_t npipes;
+    for (npipes = 0; npipes + 1 < nstages; npipes++) {
+        if (pipe2(pipes[npipes], O_CLOEXEC) == -1) {
+            printf("pipe failed: %s\n", strerror(errno));
+            all_ok = false;
+            break;
+        }
+    }
+
+    for (size_t i = 0; all_ok && i < nstages; i++) {
+        posix_spawn_file_actions_t file_actions;
+        if (posix_spawn_file_actions_init(&file_actions) != 0) {
+            all_ok = false;
+            break;
+        }
+
+        int result = 0;
+        if (i > 0) {
+            result = posix_spawn_file_actions_adddup2(&file_actions, pipes[i - 1][0], STDIN_FILENO);
+        }
+        if (result == 0 && i + 1 < nstages) {
+            result = posix_spawn_file_actions_adddup2(&file_actions, pipes[i][1], STDOUT_FILENO);
+        } else if (result == 0 && out_fd >= 0 && out_fd != STDOUT_FILENO) {
+            // the last stage writes straight into out_fd, its output never passes through us
+            result = posix_spawn_file_actions_adddup2(&file_actions, out_fd, STDOUT_FILENO);
+        }
+
+        // a stage started without its redirections would read or write the wrong files
+        if (result != 0) {
+            printf("could not set up stage %zu of the pipeline: %s\n", i, strerror(result));
+            all_ok = false;
+        } else if (spawn_command(&pids[i], stages[i], &file_actions)) {
+            started++;
+        } else {
+            all_ok = false;
+        }
+        posix_spawn_file_actions_destroy(&file_actions);
+    }
+
+    // closing our copies lets every stage see EOF or EPIPE as its neighbours exit
+    for (size_t i = 0; i < npipes; i++) {
+        close(pipes[i][0]);
+        close(pipes[i][1]);
+    }
+
+    for (size_t i = 0; i < nstages; i++) {
+        int w_status = -1;
+
+        if (i < started && waitpid(pids[i], &w_status, 0) == -1) {
+            printf("wait failed: %s\n", strerror(errno));
+            w_status = -1;
+        }
+        if (!(i < started && WIFEXITED(w_status) && WEXITSTATUS(w_status) == 0)) {
+            all_ok = false;
+        }
+        if (statuses != NULL) {
+            statuses[i] = w_status;
+        }
+    }
+
+    free(pipes);
+    free(pids);
+    return all_ok;
+}
+
+bool do_exec_pipeline_redirect(const char *outputfile, char * const *stages[], size_t nstages,
+        int *statuses)
+{
+    int fd = open(outputfile, O_WRONLY|O_TRUNC|O_CREAT|O_CLOEXEC, 0644);
+    if (fd == -1) {
+        printf("could not open %s: %s\n", outputfile, strerror(errno));
+        return false;
+    }
+
+    bool ok = do_exec_pipeline(stages, nstages, fd, statuses);
+    close(fd);
+    return ok;
+}
+
+static long elapsed_ms_since(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+bool do_exec_capture(struct exec_capture *capture, int count, ...)
+{
+    va_list args;
+    va_start(args, count);
+    char * command[count+1];
+    int i;
+    for(i=0; i<count; i++)
+    {
+        command[i] = va_arg(args, char *);
+    }
+    command[count] = NULL;
+    va_end(args);
+
+    struct output_sink sinks[2];
+    int fds[2] = { -1, -1 };    // read ends for stdout and stderr
+    int pipe_fds[2][2] = { { -1, -1 }, { -1, -1 } };
+    posix_spawn_file_actions_t file_actions;
+    bool started = false;
+    pid_t pid;
+
+    capture->status = -1;
+    capture->timed_out = false;
+    capture->truncated = false;
+    capture->out = capture->err = NULL;
+    capture->out_len = capture->err_len = 0;
+
+    for (i = 0; i < 2; i++) {
+        memset(&sinks[i], 0, sizeof(sinks[i]));
+        sinks[i].limit = capture->max_output;
+        sinks[i].callback = capture->callback;
+        sinks[i].callback_arg = capture->callback_arg;
+        sinks[i].stream = i == 0 ? STDOUT_FILENO : STDERR_FILENO;
+    }
+
+    if (posix_spawn_file_actions_init(&file_actions) != 0) {
+        return false;
+    }
+    for (i = 0; i < 2; i++) {
+        if (capture_pipe(pipe_fds[i]) == -1 ||
+                posix_spawn_file_actions_adddup2(&file_actions, pipe_fds[i][1], sinks[i].stream) != 0) {
+            break;
+        }
+    }
+    if (i == 2) {
+        started = spawn_command(&pid, command, &file_actions);
+    }
+    posix_spawn_file_actions_destroy(&file_actions);
+
+    for (i = 0; i < 2; i++) {
+        if (pipe_fds[i][1] != -1) {
+            close(pipe_fds[i][1]);
+        }
+        if (started) {
+            fds[i] = pipe_fds[i][0];
+        } else if (pipe_fds[i][0] != -1) {
+            close(pipe_fds[i][0]);
+        }
+    }
+    if (!started) {
+        return false;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int pidfd = open_pidfd(pid);
+    bool exited = false;
+    bool stopped = false;   // killed, or gave up waiting for output
+    int w_status = -1;
+
+    while (!stopped && (!exited || fds[0] >= 0 || fds[1] >= 0)) {
+        struct pollfd pfds[3];
+        int stream_of[3];
+        nfds_t nfds = 0;
+        int wait_ms = -1;
+
+        for (i = 0; i < 2; i++) {
+            if (fds[i] >= 0) {
+                pfds[nfds].fd = fds[i];
+                pfds[nfds].events = POLLIN;
+                stream_of[nfds++] = i;
+            }
+        }
+        if (!exited && pidfd >= 0) {
+            pfds[nfds].fd = pidfd;
+            pfds[nfds].events = POLLIN;
+            stream_of[nfds++] = -1;
+        } else if (!exited) {
+            wait_ms = EXEC_BATCH_POLL_MS;
+        }
+
+        if (capture->timeout_ms > 0) {
+            long remaining = capture->timeout_ms - elapsed_ms_since(&start);
+            if (remaining < 0) {
+                remaining = 0;
+            }
+            if (wait_ms < 0 || remaining < wait_ms) {
+                wait_ms = remaining;
+            }
+        }
+
+        int n = poll(pfds, nfds, wait_ms);
+        if (n == -1 && errno != EINTR) {
+            printf("poll failed: %s\n", strerror(errno));
+            stopped = true;
+        }
+
+        for (nfds_t p = 0; n > 0 && p < nfds; p++) {
+            if (stream_of[p] < 0 || pfds[p].revents == 0) {
+                continue;
+            }
+
+            int s = stream_of[p];
+            enum drain_result result = drain_fd(fds[s], &sinks[s]);
+            if (result == DRAIN_EOF) {
+                close(fds[s]);
+                fds[s] = -1;
+            } else if (result == DRAIN_STOP) {
+                stopped = true;
+            }
+        }
+
+        // output already in the pipes survives reaping, so reap as soon as the command exits
+        if (!exited && waitpid(pid, &w_status, WNOHANG) == pid) {
+            exited = true;
+        }
+
+        if (capture->timeout_ms > 0 && elapsed_ms_since(&start) >= capture->timeout_ms) {
+            capture->timed_out = !exited;
+            stopped = true;
+        }
+    }
+
+    if (!exited) {
+        if (stopped) {
+            kill(pid, SIGKILL);
+        }
+        waitpid(pid, &w_status, 0);
+    }
+    for (i = 0; i < 2; i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+    if (pidfd >= 0) {
+        close(pidfd);
+    }
+
+    capture->status = w_status;
+    capture->truncated = sinks[0].truncated || sinks[1].truncated;
+    capture->out = sinks[0].data;
+    capture->out_len = sinks[0].len;
+    capture->err = sinks[1].data;
+    capture->err_len = sinks[1].len;
+
+    return !capture->timed_out && WIFEXITED(w_status) && WEXITSTATUS(w_status) == 0;
 }
@@ -7,3 +7,121 @@ bool do_system(const char *command);
 bool do_exec(int count, ...);
 
 bool do_exec_redirect(const char *outputfile, int count, ...);
+
+/**
+ * One command run by do_exec_batch()
+ */
+struct exec_cmd {
+    /**
+     * The command and its arguments, NULL terminated.  As for do_exec(), argv[0]
+     * must be the full path to the command.
+     */
+    char * const *argv;
+    /**
+     * Set to collect the standard output of the command into output
+     */
+    bool capture_stdout;
+
+    /**
+     * Wait status of the command as reported by waitpid(), or -1 if it could
+     * not be started or reaped, or was killed because the batch failed.  Filled
+     * in by do_exec_batch().
+     */
+    int status;
+    /**
+     * NUL terminated standard output when capture_stdout is set, otherwise NULL.
+     * Filled in by do_exec_batch(), free() it when done.
+     */
+    char *output;
+    size_t output_len;
+};
+
+/**
+* Runs the @param count commands in @param cmds in parallel, never more than @param max_parallel
+*   at a time (0 means one per online CPU).  Commands are started in order as earlier ones
+*   finish.  Exits are collected through pidfds, and captured output through pipes, all
+*   multiplexed with epoll.
+* @return true if every command was started and exited with status 0.  The status and output
+*   of each command is stored in its struct exec_cmd either way.
+*/
+bool do_exec_batch(struct exec_cmd *cmds, size_t count, size_t max_parallel);
+
+/**
+* Runs the @param nstages commands in @param stages as a pipeline, the standard output of
+*   each stage connected to the standard input of the next with a pipe, like a shell pipeline
+*   but without starting /bin/sh.  Each stage is a NULL terminated argument list whose first
+*   element is the full path to the command, as for do_exec().
+* @param out_fd receives the standard output of the last stage, which writes to it directly
+*   so the data never passes through this process.  Pass -1 to leave it on our stdout.
+* @param statuses if not NULL, an array of @param nstages which receives the wait status
+*   of each stage, or -1 for a stage which could not be started.
+* @return true if every stage was started and exited with status 0
+*/
+bool do_exec_pipeline(char * const *stages[], size_t nstages, int out_fd, int *statuses);
+
+/**
+* As do_exec_pipeline(), with the last stage writing to @param outputfile, which is
+*   created or truncated like for do_exec_redirect().
+*/
+bool do_exec_pipeline_redirect(const char *outputfile, char * const *stages[], size_t nstages,
+        int *statuses);
+
+/**
+* Receives output from do_exec_capture() as it arrives.
+* @param stream STDOUT_FILENO or STDERR_FILENO
+* @param data @param len bytes of output, only valid for the duration of the call
+* @param arg the callback_arg of the struct exec_capture
+* @return true to continue, false to kill the command
+*/
+typedef bool (*exec_output_cb)(int stream, const char *data, size_t len, void *arg);
+
+/**
+ * Options and results for do_exec_capture()
+ */
+struct exec_capture {
+    /**
+     * If set, output is streamed to this callback instead of being buffered in out and err
+     */
+    exec_output_cb callback;
+    void *callback_arg;
+    /**
+     * Most bytes buffered per stream, 0 for no limit.  Output past the limit is read and
+     * discarded, so the command is not blocked, and truncated is set.
+     */
+    size_t max_output;
+    /**
+     * Milliseconds after which the command is killed with SIGKILL, 0 for no timeout
+     */
+    int timeout_ms;
+
+    /**
+     * Wait status of the command as reported by waitpid(), or -1 if it could not be
+     * started.  Filled in by do_exec_capture().
+     */
+    int status;
+    /**
+     * Set if the command was killed because timeout_ms expired
+     */
+    bool timed_out;
+    /**
+     * Set if some output was discarded because of max_output or an allocation failure
+     */
+    bool truncated;
+    /**
+     * NUL terminated buffered standard output and error, NULL if there was none or a
+     * callback was used.  Filled in by do_exec_capture(), free() them when done.
+     */
+    char *out;
+    size_t out_len;
+    char *err;
+    size_t err_len;
+};
+
+/**
+* Runs a command as do_exec() does, collecting its standard output and standard error through
+*   pipes into buffers or the streaming callback of @param capture, instead of a file.
+* @param capture options for the run, and where its results are stored
+* All other parameters, see do_exec above
+* @return true if the command was started, did not time out and exited with status 0
+*/
+bool do_exec_capture(struct exec_capture *capture, int count, ...);
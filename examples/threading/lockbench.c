@@ -0,0 +1,392 @@
+/**
+ * @file lockbench.c
+ * @brief Compares lock implementations under contention, to pick the lock used for
+ * work_file_lock in aesdsocket.
+ *
+ * Like start_thread_obtaining_mutex() in threading.c, each thread gets a dynamically
+ * allocated thread data structure which it returns to the joiner.  Each thread
+ * repeatedly obtains the lock, holds it for hold_ns of busy work and releases it,
+ * recording how long every acquisition waited.
+ *
+ * Usage: lockbench [milliseconds per run] [max threads]
+ */
+
+#define _GNU_SOURCE
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ERROR_LOG(msg,...) printf("lockbench ERROR: " msg "\n" , ##__VA_ARGS__)
+
+#define DEFAULT_RUN_MS 200
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define cpu_relax() __asm__ __volatile__("yield")
+#else
+#define cpu_relax() do { } while (0)
+#endif
+
+static const long hold_ns_values[] = { 0, 100, 1000 };
+
+/*
+ * Wait latency histogram: 8 linear sub-buckets per power of two, so percentiles are
+ * accurate to about 12%.
+ */
+#define HIST_SUB_BITS 3
+#define HIST_BUCKETS (64 << HIST_SUB_BITS)
+
+static unsigned hist_bucket(uint64_t ns)
+{
+    if (ns < (1u << HIST_SUB_BITS)) {
+        return ns;
+    }
+    unsigned msb = 63 - __builtin_clzll(ns);
+    unsigned sub = (ns >> (msb - HIST_SUB_BITS)) & ((1u << HIST_SUB_BITS) - 1);
+    return ((msb - HIST_SUB_BITS + 1) << HIST_SUB_BITS) + sub;
+}
+
+static uint64_t hist_bucket_low(unsigned bucket)
+{
+    if (bucket < (1u << HIST_SUB_BITS)) {
+        return bucket;
+    }
+    unsigned msb = (bucket >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+    unsigned sub = bucket & ((1u << HIST_SUB_BITS) - 1);
+    return (1ull << msb) | ((uint64_t)sub << (msb - HIST_SUB_BITS));
+}
+
+static uint64_t hist_percentile(const uint64_t *hist, uint64_t total, double pct)
+{
+    uint64_t target = total * pct / 100.0;
+    uint64_t seen = 0;
+
+    for (unsigned b = 0; b < HIST_BUCKETS; b++) {
+        seen += hist[b];
+        if (seen > target) {
+            return hist_bucket_low(b);
+        }
+    }
+    return 0;
+}
+
+struct ticket_lock {
+    atomic_uint next;
+    atomic_uint serving;
+};
+
+union bench_lock {
+    pthread_mutex_t mutex;
+    pthread_spinlock_t spin;
+    struct ticket_lock ticket;
+    atomic_int futex;   // 0 unlocked, 1 locked, 2 locked with waiters
+};
+
+static void mutex_init(union bench_lock *l)
+{
+    pthread_mutex_init(&l->mutex, NULL);
+}
+
+static void adaptive_mutex_init(union bench_lock *l)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ADAPTIVE_NP);
+    pthread_mutex_init(&l->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+static void mutex_lock(union bench_lock *l)
+{
+    pthread_mutex_lock(&l->mutex);
+}
+
+static void mutex_unlock(union bench_lock *l)
+{
+    pthread_mutex_unlock(&l->mutex);
+}
+
+static void mutex_destroy(union bench_lock *l)
+{
+    pthread_mutex_destroy(&l->mutex);
+}
+
+static void spin_init(union bench_lock *l)
+{
+    pthread_spin_init(&l->spin, PTHREAD_PROCESS_PRIVATE);
+}
+
+static void spin_lock(union bench_lock *l)
+{
+    pthread_spin_lock(&l->spin);
+}
+
+static void spin_unlock(union bench_lock *l)
+{
+    pthread_spin_unlock(&l->spin);
+}
+
+static void spin_destroy(union bench_lock *l)
+{
+    pthread_spin_destroy(&l->spin);
+}
+
+static void ticket_init(union bench_lock *l)
+{
+    atomic_init(&l->ticket.next, 0);
+    atomic_init(&l->ticket.serving, 0);
+}
+
+static void ticket_lock(union bench_lock *l)
+{
+    unsigned my_ticket = atomic_fetch_add_explicit(&l->ticket.next, 1, memory_order_relaxed);
+
+    while (atomic_load_explicit(&l->ticket.serving, memory_order_acquire) != my_ticket) {
+        cpu_relax();
+    }
+}
+
+static void ticket_unlock(union bench_lock *l)
+{
+    unsigned serving = atomic_load_explicit(&l->ticket.serving, memory_order_relaxed);
+    atomic_store_explicit(&l->ticket.serving, serving + 1, memory_order_release);
+}
+
+static void nop_destroy(union bench_lock *l)
+{
+}
+
+static void futex_init(union bench_lock *l)
+{
+    atomic_init(&l->futex, 0);
+}
+
+static long futex(atomic_int *uaddr, int op, int val)
+{
+    return syscall(SYS_futex, uaddr, op, val, NULL, NULL, 0);
+}
+
+/* The three state mutex from Ulrich Drepper's "Futexes Are Tricky" */
+static void futex_lock(union bench_lock *l)
+{
+    int c = 0;
+
+    if (atomic_compare_exchange_strong(&l->futex, &c, 1)) {
+        return;
+    }
+    if (c != 2) {
+        c = atomic_exchange(&l->futex, 2);
+    }
+    while (c != 0) {
+        futex(&l->futex, FUTEX_WAIT_PRIVATE, 2);
+        c = atomic_exchange(&l->futex, 2);
+    }
+}
+
+static void futex_unlock(union bench_lock *l)
+{
+    if (atomic_fetch_sub(&l->futex, 1) != 1) {
+        atomic_store(&l->futex, 0);
+        futex(&l->futex, FUTEX_WAKE_PRIVATE, 1);
+    }
+}
+
+struct lock_ops {
+    const char *name;
+    void (*init)(union bench_lock *);
+    void (*lock)(union bench_lock *);
+    void (*unlock)(union bench_lock *);
+    void (*destroy)(union bench_lock *);
+};
+
+static const struct lock_ops locks[] = {
+    { "mutex", mutex_init, mutex_lock, mutex_unlock, mutex_destroy },
+    { "adaptive", adaptive_mutex_init, mutex_lock, mutex_unlock, mutex_destroy },
+    { "spinlock", spin_init, spin_lock, spin_unlock, spin_destroy },
+    { "ticket", ticket_init, ticket_lock, ticket_unlock, nop_destroy },
+    { "futex", futex_init, futex_lock, futex_unlock, nop_destroy },
+};
+
+/**
+ * The shared lock, on its own cache line so threads only contend on the lock itself
+ */
+struct shared_lock {
+    union bench_lock lock;
+} __attribute__((aligned(64)));
+
+/**
+ * Allocated for each thread and returned by it, as with struct thread_data in threading.h
+ */
+struct lockbench_thread_data {
+    const struct lock_ops *ops;
+    struct shared_lock *shared;
+    pthread_mutex_t *starting;
+    pthread_barrier_t *start;
+    atomic_bool *stop;
+    long hold_ns;
+
+    uint64_t acquisitions;
+    uint64_t wait_hist[HIST_BUCKETS];
+    bool thread_complete_success;
+};
+
+static inline uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void busy_wait_ns(long ns)
+{
+    if (ns <= 0) {
+        return;
+    }
+    uint64_t until = now_ns() + ns;
+    while (now_ns() < until) {
+        cpu_relax();
+    }
+}
+
+static void *lockbench_threadfunc(void *thread_param)
+{
+    struct lockbench_thread_data *td = thread_param;
+
+    // held by run_one until it knows how many threads the barrier is for
+    pthread_mutex_lock(td->starting);
+    pthread_mutex_unlock(td->starting);
+    pthread_barrier_wait(td->start);
+
+    while (!atomic_load_explicit(td->stop, memory_order_relaxed)) {
+        uint64_t before = now_ns();
+        td->ops->lock(&td->shared->lock);
+        uint64_t waited = now_ns() - before;
+
+        busy_wait_ns(td->hold_ns);
+        td->ops->unlock(&td->shared->lock);
+
+        td->wait_hist[hist_bucket(waited)]++;
+        td->acquisitions++;
+    }
+
+    td->thread_complete_success = true;
+    return thread_param;
+}
+
+/**
+ * Runs @param nthreads threads contending on one lock of type @param ops for @param run_ms,
+ * and prints one result line.
+ * @return false if a thread could not be started
+ */
+static bool run_one(const struct lock_ops *ops, int nthreads, long hold_ns, long run_ms)
+{
+    struct shared_lock shared;
+    pthread_mutex_t starting = PTHREAD_MUTEX_INITIALIZER;
+    pthread_barrier_t start;
+    atomic_bool stop;
+    pthread_t threads[nthreads];
+    uint64_t hist[HIST_BUCKETS] = { 0 };
+    uint64_t total = 0;
+    bool ok = true;
+    int started;
+
+    ops->init(&shared.lock);
+    pthread_barrier_init(&start, NULL, nthreads + 1);
+    atomic_init(&stop, false);
+
+    pthread_mutex_lock(&starting);
+    for (started = 0; started < nthreads; started++) {
+        struct lockbench_thread_data *td = calloc(1, sizeof(*td));
+        if (td == NULL) {
+            break;
+        }
+        td->ops = ops;
+        td->shared = &shared;
+        td->starting = &starting;
+        td->start = &start;
+        td->stop = &stop;
+        td->hold_ns = hold_ns;
+        if (pthread_create(&threads[started], NULL, lockbench_threadfunc, td) != 0) {
+            free(td);
+            break;
+        }
+    }
+    if (started < nthreads) {
+        ERROR_LOG("could only start %d of %d threads", started, nthreads);
+        // none has reached the barrier yet, so it can be sized for the ones we have
+        pthread_barrier_destroy(&start);
+        pthread_barrier_init(&start, NULL, started + 1);
+        atomic_store(&stop, true);
+        ok = false;
+    }
+    pthread_mutex_unlock(&starting);
+
+    pthread_barrier_wait(&start);
+    uint64_t begin = now_ns();
+    if (ok) {
+        usleep(run_ms * 1000);
+    }
+    atomic_store(&stop, true);
+
+    for (int i = 0; i < started; i++) {
+        struct lockbench_thread_data *td;
+        pthread_join(threads[i], (void **)&td);
+        total += td->acquisitions;
+        for (unsigned b = 0; b < HIST_BUCKETS; b++) {
+            hist[b] += td->wait_hist[b];
+        }
+        free(td);
+    }
+    double elapsed_s = (now_ns() - begin) / 1e9;
+
+    pthread_barrier_destroy(&start);
+    pthread_mutex_destroy(&starting);
+    ops->destroy(&shared.lock);
+
+    if (ok) {
+        printf("%-9s %7d %7ld %12.0f %9llu %9llu %9llu\n", ops->name, nthreads, hold_ns,
+                total / elapsed_s,
+                (unsigned long long)hist_percentile(hist, total, 50),
+                (unsigned long long)hist_percentile(hist, total, 99),
+                (unsigned long long)hist_percentile(hist, total, 99.9));
+    }
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    long run_ms = argc > 1 ? atol(argv[1]) : DEFAULT_RUN_MS;
+    long max_threads = argc > 2 ? atol(argv[2]) : sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (run_ms <= 0 || max_threads <= 0) {
+        fprintf(stderr, "usage: %s [milliseconds per run] [max threads]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%-9s %7s %7s %12s %9s %9s %9s\n", "lock", "threads", "hold_ns", "acq/s",
+            "p50_ns", "p99_ns", "p99.9_ns");
+    for (size_t h = 0; h < sizeof(hold_ns_values) / sizeof(hold_ns_values[0]); h++) {
+        for (size_t l = 0; l < sizeof(locks) / sizeof(locks[0]); l++) {
+            // powers of two, always ending with max_threads itself
+            for (long t = 1; ; t = t * 2 > max_threads ? max_threads : t * 2) {
+                if (!run_one(&locks[l], t, hold_ns_values[h], run_ms)) {
+                    return 1;
+                }
+                if (t == max_threads) {
+                    break;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
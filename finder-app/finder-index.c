@@ -0,0 +1,322 @@
+/* on-disk cache of per-file match counts for finder
+
+   Layout, in host byte order:
+     header:  magic, version, number of search strings
+     strings: u32 length + bytes, for each search string
+     files:   u32 path length, path, u64 size, i64 mtime_ns,
+              i64 match count per search string (-1 = unknown)
+   The file list ends at EOF. Paths are stored as the walk produced
+   them, so an index is only useful for the same filesdir argument. */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "finder-index.h"
+
+#define FINDER_INDEX_MAGIC 0x58444e46u	// "FNDX"
+#define FINDER_INDEX_VERSION 1
+#define FINDER_INDEX_MAX_STRINGS 16
+#define FINDER_INDEX_MAX_PATH 4096
+#define FINDER_INDEX_MAX_STRING (64 * 1024)
+
+struct index_entry {
+	char *path;
+	uint64_t size;
+	int64_t mtime_ns;
+	int64_t *counts;	// indexed by position in the old string list
+};
+
+struct finder_index {
+	/* strings the saved index will carry; cur is this run's */
+	char *strings[FINDER_INDEX_MAX_STRINGS];
+	int old_slot[FINDER_INDEX_MAX_STRINGS];	// position in the loaded file, or -1
+	unsigned int nstrings;
+	unsigned int cur;
+	unsigned int old_nstrings;
+
+	struct index_entry *entries;
+	size_t nentries;
+	size_t *table;		// open addressing over entries, SIZE_MAX = empty
+	size_t table_mask;
+};
+
+static uint64_t hash_path(const char *s)
+{
+	uint64_t h = 14695981039346656037ull;	// FNV-1a
+
+	while (*s) {
+		h ^= (unsigned char)*s++;
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+static const struct index_entry *find_entry(const struct finder_index *idx, const char *path)
+{
+	if (idx->table == NULL)
+		return NULL;
+	for (size_t i = hash_path(path) & idx->table_mask;; i = (i + 1) & idx->table_mask) {
+		size_t e = idx->table[i];
+		if (e == SIZE_MAX)
+			return NULL;
+		if (strcmp(idx->entries[e].path, path) == 0)
+			return &idx->entries[e];
+	}
+}
+
+static bool build_table(struct finder_index *idx)
+{
+	size_t slots = 16;
+
+	while (slots < idx->nentries * 2)
+		slots *= 2;
+	idx->table = malloc(slots * sizeof(*idx->table));
+	if (idx->table == NULL)
+		return false;
+	memset(idx->table, 0xff, slots * sizeof(*idx->table));
+	idx->table_mask = slots - 1;
+
+	for (size_t e = 0; e < idx->nentries; e++) {
+		size_t i = hash_path(idx->entries[e].path) & idx->table_mask;
+		while (idx->table[i] != SIZE_MAX)
+			i = (i + 1) & idx->table_mask;
+		idx->table[i] = e;
+	}
+	return true;
+}
+
+static bool read_u32(FILE *fp, uint32_t *v)
+{
+	return fread(v, sizeof(*v), 1, fp) == 1;
+}
+
+/* reads a u32-length-prefixed string no longer than max */
+static char *read_string(FILE *fp, uint32_t max)
+{
+	uint32_t len;
+	char *s;
+
+	if (!read_u32(fp, &len) || len == 0 || len > max)
+		return NULL;
+	s = malloc(len + 1);
+	if (s == NULL)
+		return NULL;
+	if (fread(s, 1, len, fp) != len) {
+		free(s);
+		return NULL;
+	}
+	s[len] = '\0';
+	return s;
+}
+
+static void drop_entries(struct finder_index *idx)
+{
+	for (size_t e = 0; e < idx->nentries; e++) {
+		free(idx->entries[e].path);
+		free(idx->entries[e].counts);
+	}
+	free(idx->entries);
+	idx->entries = NULL;
+	idx->nentries = 0;
+}
+
+/* returns false on a malformed file; idx then holds no entries */
+static bool read_index(struct finder_index *idx, FILE *fp, char **old_strings)
+{
+	uint32_t magic, version, n;
+	size_t capacity = 0;
+
+	if (!read_u32(fp, &magic) || magic != FINDER_INDEX_MAGIC ||
+	    !read_u32(fp, &version) || version != FINDER_INDEX_VERSION ||
+	    !read_u32(fp, &n) || n > FINDER_INDEX_MAX_STRINGS)
+		return false;
+	for (; idx->old_nstrings < n; idx->old_nstrings++) {
+		old_strings[idx->old_nstrings] = read_string(fp, FINDER_INDEX_MAX_STRING);
+		if (old_strings[idx->old_nstrings] == NULL)
+			return false;
+	}
+
+	for (;;) {
+		struct index_entry entry = { 0 };
+		int c = getc(fp);
+		if (c == EOF)
+			return true;
+		ungetc(c, fp);
+
+		entry.path = read_string(fp, FINDER_INDEX_MAX_PATH);
+		entry.counts = malloc((n ? n : 1) * sizeof(*entry.counts));
+		if (entry.path == NULL || entry.counts == NULL ||
+		    fread(&entry.size, sizeof(entry.size), 1, fp) != 1 ||
+		    fread(&entry.mtime_ns, sizeof(entry.mtime_ns), 1, fp) != 1 ||
+		    fread(entry.counts, sizeof(*entry.counts), n, fp) != n) {
+			free(entry.path);
+			free(entry.counts);
+			drop_entries(idx);
+			return false;
+		}
+		if (idx->nentries == capacity) {
+			capacity = capacity ? capacity * 2 : 256;
+			struct index_entry *grown = realloc(idx->entries, capacity * sizeof(*grown));
+			if (grown == NULL) {
+				free(entry.path);
+				free(entry.counts);
+				drop_entries(idx);
+				return false;
+			}
+			idx->entries = grown;
+		}
+		idx->entries[idx->nentries++] = entry;
+	}
+}
+
+struct finder_index *finder_index_load(const char *path, const char *searchstr)
+{
+	struct finder_index *idx = calloc(1, sizeof(*idx));
+	char *old_strings[FINDER_INDEX_MAX_STRINGS] = { 0 };
+
+	if (idx == NULL)
+		return NULL;
+
+	FILE *fp = fopen(path, "rb");
+	if (fp != NULL) {
+		if (!read_index(idx, fp, old_strings)) {
+			fprintf(stderr, "finder: ignoring malformed index %s\n", path);
+			for (unsigned int i = 0; i < idx->old_nstrings; i++)
+				free(old_strings[i]);
+			idx->old_nstrings = 0;
+		}
+		fclose(fp);
+	} else if (errno != ENOENT) {
+		fprintf(stderr, "finder: %s: %s\n", path, strerror(errno));
+	}
+
+	/* keep the most recent strings, with this run's last */
+	unsigned int first = 0, found = idx->old_nstrings;
+	for (unsigned int i = 0; i < idx->old_nstrings; i++)
+		if (strcmp(old_strings[i], searchstr) == 0)
+			found = i;
+	if (found == idx->old_nstrings && idx->old_nstrings == FINDER_INDEX_MAX_STRINGS)
+		first = 1;
+	for (unsigned int i = 0; i < idx->old_nstrings; i++) {
+		if (i < first || i == found) {
+			free(old_strings[i]);
+			continue;
+		}
+		idx->old_slot[idx->nstrings] = i;
+		idx->strings[idx->nstrings++] = old_strings[i];
+	}
+	idx->cur = idx->nstrings;
+	idx->old_slot[idx->cur] = found < idx->old_nstrings ? (int)found : -1;
+	idx->strings[idx->nstrings++] = strdup(searchstr);
+
+	if (idx->strings[idx->cur] == NULL || !build_table(idx)) {
+		finder_index_free(idx);
+		return NULL;
+	}
+	return idx;
+}
+
+long finder_index_lookup(const struct finder_index *idx, const struct finder_file *file)
+{
+	int slot = idx->old_slot[idx->cur];
+
+	if (slot < 0)
+		return -1;
+	const struct index_entry *e = find_entry(idx, file->path);
+	if (e == NULL || e->size != file->size || e->mtime_ns != file->mtime_ns)
+		return -1;
+	return e->counts[slot];
+}
+
+static bool write_u32(FILE *fp, uint32_t v)
+{
+	return fwrite(&v, sizeof(v), 1, fp) == 1;
+}
+
+static bool write_string(FILE *fp, const char *s)
+{
+	size_t len = strlen(s);
+
+	return write_u32(fp, len) && fwrite(s, 1, len, fp) == len;
+}
+
+static bool write_file_entry(const struct finder_index *idx, FILE *fp,
+			     const struct finder_file *file, int64_t started_ns)
+{
+	const struct index_entry *old = NULL;
+	bool racy = file->mtime_ns >= started_ns;
+
+	if (strlen(file->path) > FINDER_INDEX_MAX_PATH)
+		return true;	// not worth indexing; it is simply rescanned
+	if (!racy) {
+		old = find_entry(idx, file->path);
+		if (old != NULL && (old->size != file->size || old->mtime_ns != file->mtime_ns))
+			old = NULL;
+	}
+	if (!write_string(fp, file->path) ||
+	    fwrite(&file->size, sizeof(file->size), 1, fp) != 1 ||
+	    fwrite(&file->mtime_ns, sizeof(file->mtime_ns), 1, fp) != 1)
+		return false;
+	for (unsigned int i = 0; i < idx->nstrings; i++) {
+		int64_t count = -1;
+		if (i == idx->cur && !racy)
+			count = file->matches;
+		else if (old != NULL)
+			count = old->counts[idx->old_slot[i]];
+		if (fwrite(&count, sizeof(count), 1, fp) != 1)
+			return false;
+	}
+	return true;
+}
+
+bool finder_index_save(const struct finder_index *idx, const char *path,
+		       struct finder_file * const *files, size_t count, int64_t started_ns)
+{
+	size_t len = strlen(path);
+	char *tmp = malloc(len + sizeof(".tmp"));
+	bool ok;
+
+	if (tmp == NULL)
+		return false;
+	memcpy(tmp, path, len);
+	memcpy(tmp + len, ".tmp", sizeof(".tmp"));
+
+	FILE *fp = fopen(tmp, "wb");
+	if (fp == NULL) {
+		fprintf(stderr, "finder: %s: %s\n", tmp, strerror(errno));
+		free(tmp);
+		return false;
+	}
+	ok = write_u32(fp, FINDER_INDEX_MAGIC) && write_u32(fp, FINDER_INDEX_VERSION) &&
+	     write_u32(fp, idx->nstrings);
+	for (unsigned int i = 0; ok && i < idx->nstrings; i++)
+		ok = write_string(fp, idx->strings[i]);
+	for (size_t i = 0; ok && i < count; i++)
+		ok = write_file_entry(idx, fp, files[i], started_ns);
+	if (fclose(fp) != 0)
+		ok = false;
+
+	// rename so a concurrent or interrupted run never sees a partial index
+	if (ok && rename(tmp, path) == -1)
+		ok = false;
+	if (!ok) {
+		fprintf(stderr, "finder: could not write index %s: %s\n", path, strerror(errno));
+		unlink(tmp);
+	}
+	free(tmp);
+	return ok;
+}
+
+void finder_index_free(struct finder_index *idx)
+{
+	if (idx == NULL)
+		return;
+	for (unsigned int i = 0; i < idx->nstrings; i++)
+		free(idx->strings[i]);
+	drop_entries(idx);
+	free(idx->table);
+	free(idx);
+}
@@ -0,0 +1,43 @@
+#ifndef finder_index_h_
+#define finder_index_h_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* a regular file found by the walk, with its search result once known */
+struct finder_file {
+	uint64_t size;
+	int64_t mtime_ns;
+	long matches;		// -1 until searched or found in the index
+	char path[];
+};
+
+struct finder_index;
+
+/**
+ * Loads the index at @param path for a search for @param searchstr.
+ * A missing or unreadable index yields an empty one, so the first run
+ * simply scans everything.
+ * @return NULL only if memory ran out.
+ */
+struct finder_index *finder_index_load(const char *path, const char *searchstr);
+
+/**
+ * @return the cached match count for @param file if its size and mtime
+ * are unchanged since it was indexed, -1 if it has to be searched.
+ */
+long finder_index_lookup(const struct finder_index *idx, const struct finder_file *file);
+
+/**
+ * Replaces the index at @param path with the @param count files of this
+ * walk. Counts for other search strings are carried over for unchanged
+ * files. Files modified at or after @param started_ns are stored without
+ * counts, since they may change again within the same timestamp tick.
+ */
+bool finder_index_save(const struct finder_index *idx, const char *path,
+		       struct finder_file * const *files, size_t count, int64_t started_ns);
+
+void finder_index_free(struct finder_index *idx);
+
+#endif
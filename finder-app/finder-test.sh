@@ -52,10 +52,12 @@ fi
 #make clean
 #make
 
+# one writer process for all files; printf is a shell builtin. records are
+# NUL separated so a tab or newline in WRITESTR survives
 for i in $( seq 1 $NUMFILES)
 do
-	writer "$WRITEDIR/${username}$i.txt" "$WRITESTR"
-done
+	printf '%s\0%s\0' "$WRITEDIR/${username}$i.txt" "$WRITESTR"
+done | writer -b -0
 
 OUTPUTSTRING=$(finder.sh "$WRITEDIR" "$WRITESTR" > /tmp/assignment4-result.txt)
 
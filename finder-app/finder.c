@@ -0,0 +1,518 @@
+/* given 2 args, first is a directory, second is a search string,
+   print the number of regular files below the directory and the
+   number of lines in them matching the string.
+
+   Native replacement for the find|wc + grep -r|wc pipeline in
+   finder.sh: the tree is walked once with getdents64 by the main
+   thread while a pool of workers mmaps and searches the files it
+   finds. Output is identical to the script's.
+
+   With -i indexfile, per-file match counts are cached across runs and
+   files whose size and mtime are unchanged are not read again. */
+
+#define _GNU_SOURCE // memmem, O_DIRECTORY
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <regex.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "finder-index.h"
+
+#define DIRENT_BUF_SIZE (32 * 1024)
+#define MAX_WORKERS 16
+/* smaller files are read into a per-worker buffer; mapping and unmapping
+   them costs more than the copy once several workers share the mm */
+#define MMAP_THRESHOLD (1024 * 1024)
+
+/* getdents64 record layout; glibc only exposes a wrapper from 2.30 on */
+struct linux_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+/* files discovered by the walker, searched in order by the workers
+   unless the index already supplied their count */
+struct file_queue {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct finder_file **files;
+	size_t count;
+	size_t capacity;
+	size_t next;
+	bool done;
+};
+
+struct matcher {
+	const char *needle;
+	size_t needle_len;
+	bool use_regex;
+	regex_t re;
+};
+
+struct worker {
+	pthread_t thread;
+	struct file_queue *queue;
+	const struct matcher *matcher;
+	char *readbuf;
+	char *scratch;
+	size_t scratch_size;
+};
+
+static bool queue_push(struct file_queue *q, struct finder_file *file)
+{
+	pthread_mutex_lock(&q->lock);
+	if (q->count == q->capacity) {
+		size_t capacity = q->capacity ? q->capacity * 2 : 1024;
+		struct finder_file **files = realloc(q->files, capacity * sizeof(*files));
+		if (files == NULL) {
+			pthread_mutex_unlock(&q->lock);
+			return false;
+		}
+		q->files = files;
+		q->capacity = capacity;
+	}
+	q->files[q->count++] = file;
+	if (file->matches < 0)
+		pthread_cond_signal(&q->cond);
+	pthread_mutex_unlock(&q->lock);
+	return true;
+}
+
+static void queue_finish(struct file_queue *q)
+{
+	pthread_mutex_lock(&q->lock);
+	q->done = true;
+	pthread_cond_broadcast(&q->cond);
+	pthread_mutex_unlock(&q->lock);
+}
+
+/* returns the next file to search, or NULL once the walk is complete */
+static struct finder_file *queue_pop(struct file_queue *q)
+{
+	struct finder_file *file = NULL;
+
+	pthread_mutex_lock(&q->lock);
+	for (;;) {
+		while (q->next == q->count && !q->done)
+			pthread_cond_wait(&q->cond, &q->lock);
+		if (q->next == q->count)
+			break;
+		file = q->files[q->next++];
+		if (file->matches < 0)
+			break;
+		file = NULL;
+	}
+	pthread_mutex_unlock(&q->lock);
+	return file;
+}
+
+/* grep treats these as BRE operators; anything else is a literal */
+static bool is_fixed_string(const char *s)
+{
+	return strpbrk(s, ".[]*^$\\") == NULL;
+}
+
+static bool line_matches(struct worker *w, const char *line, size_t len)
+{
+#ifdef REG_STARTEND
+	regmatch_t m = { .rm_so = 0, .rm_eo = len };
+
+	return regexec(&w->matcher->re, line, 1, &m, REG_STARTEND) == 0;
+#else
+	if (len + 1 > w->scratch_size) {
+		char *scratch = realloc(w->scratch, len + 1);
+		if (scratch == NULL)
+			return false;
+		w->scratch = scratch;
+		w->scratch_size = len + 1;
+	}
+	memcpy(w->scratch, line, len);
+	w->scratch[len] = '\0';
+	return regexec(&w->matcher->re, w->scratch, 0, NULL, 0) == 0;
+#endif
+}
+
+/**
+ * @return the number of lines in @param buf of @param len bytes that match,
+ * counting a final unterminated line the way grep does.
+ */
+static unsigned long count_matching_lines(struct worker *w, const char *buf, size_t len)
+{
+	const struct matcher *m = w->matcher;
+	const char *end = buf + len;
+	const char *p = buf;
+	unsigned long lines = 0;
+
+	if (!m->use_regex) {
+		// jump from match to match, skipping the rest of each matched line
+		while (p < end) {
+			const char *hit = memmem(p, end - p, m->needle, m->needle_len);
+			if (hit == NULL)
+				break;
+			lines++;
+			const char *nl = memchr(hit + m->needle_len, '\n', end - hit - m->needle_len);
+			if (nl == NULL)
+				break;
+			p = nl + 1;
+		}
+		return lines;
+	}
+
+	while (p < end) {
+		const char *nl = memchr(p, '\n', end - p);
+		const char *eol = nl ? nl : end;
+		if (line_matches(w, p, eol - p))
+			lines++;
+		p = eol + 1;
+	}
+	return lines;
+}
+
+/* returns the number of matching lines, or -1 if the file could not be read */
+static long search_file(struct worker *w, const char *path)
+{
+	long lines = 0;
+	struct stat st;
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK);
+	if (fd == -1) {
+		fprintf(stderr, "finder: %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	if (fstat(fd, &st) == -1) {
+		fprintf(stderr, "finder: %s: %s\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+
+	size_t len = st.st_size;
+	char *buf;
+	if (len < MMAP_THRESHOLD) {
+		ssize_t n = 0;
+		size_t got = 0;
+		buf = w->readbuf;
+		while (got < len && (n = pread(fd, buf + got, len - got, got)) > 0)
+			got += n;
+		if (n == -1) {
+			fprintf(stderr, "finder: %s: %s\n", path, strerror(errno));
+			lines = -1;
+		}
+		len = got;
+	} else {
+		buf = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (buf == MAP_FAILED) {
+			fprintf(stderr, "finder: %s: %s\n", path, strerror(errno));
+			close(fd);
+			return -1;
+		}
+		madvise(buf, len, MADV_SEQUENTIAL);
+	}
+	close(fd);
+
+	// grep reports matches in binary files on stderr only, so they add no lines
+	if (lines == 0 && memchr(buf, '\0', len) == NULL)
+		lines = count_matching_lines(w, buf, len);
+
+	if (buf != w->readbuf)
+		munmap(buf, len);
+	return lines;
+}
+
+static void *search_worker(void *arg)
+{
+	struct worker *w = arg;
+	struct finder_file *file;
+
+	w->readbuf = malloc(MMAP_THRESHOLD);
+	if (w->readbuf == NULL) {
+		perror("finder");
+		exit(1);
+	}
+	while ((file = queue_pop(w->queue)) != NULL)
+		file->matches = search_file(w, file->path);
+	return NULL;
+}
+
+static char *join_path(const char *dir, const char *name)
+{
+	size_t dlen = strlen(dir);
+	size_t nlen = strlen(name);
+	char *path = malloc(dlen + nlen + 2);
+
+	if (path == NULL)
+		return NULL;
+	memcpy(path, dir, dlen);
+	path[dlen] = '/';
+	memcpy(path + dlen + 1, name, nlen + 1);
+	return path;
+}
+
+/**
+ * @return a new file entry for @param name in @param dir, with its count
+ * taken from @param idx when it is unchanged since the last indexed run.
+ */
+static struct finder_file *new_file(const char *dir, int dfd, const char *name,
+				    const struct finder_index *idx)
+{
+	size_t dlen = strlen(dir);
+	size_t nlen = strlen(name);
+	struct finder_file *file = malloc(sizeof(*file) + dlen + nlen + 2);
+	struct stat st;
+
+	if (file == NULL)
+		return NULL;
+	memcpy(file->path, dir, dlen);
+	file->path[dlen] = '/';
+	memcpy(file->path + dlen + 1, name, nlen + 1);
+	file->size = 0;
+	file->mtime_ns = 0;
+	file->matches = -1;
+
+	// only an indexed run needs the mtime, which getdents does not provide
+	if (idx != NULL && fstatat(dfd, name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+		file->size = st.st_size;
+		file->mtime_ns = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+		file->matches = finder_index_lookup(idx, file);
+	}
+	return file;
+}
+
+/**
+ * Walks the tree below @param root without following symlinks, queueing
+ * every regular file for the workers, or with its count from @param idx
+ * if that is non-NULL and has one.
+ * @return false if memory ran out; unreadable directories are reported
+ * and skipped like find and grep do.
+ */
+static bool walk_tree(const char *root, struct file_queue *q, const struct finder_index *idx)
+{
+	size_t depth = 0, capacity = 64;
+	char **stack = malloc(capacity * sizeof(*stack));
+	char *dents = malloc(DIRENT_BUF_SIZE);
+	bool ok = stack != NULL && dents != NULL;
+
+	if (ok) {
+		stack[depth] = strdup(root);
+		ok = stack[depth++] != NULL;
+	}
+
+	while (ok && depth > 0) {
+		char *dir = stack[--depth];
+		int dfd = openat(AT_FDCWD, dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (dfd == -1) {
+			fprintf(stderr, "finder: %s: %s\n", dir, strerror(errno));
+			free(dir);
+			continue;
+		}
+
+		long n;
+		while (ok && (n = syscall(SYS_getdents64, dfd, dents, DIRENT_BUF_SIZE)) > 0) {
+			for (long off = 0; ok && off < n;) {
+				struct linux_dirent64 *d = (struct linux_dirent64 *)(dents + off);
+				unsigned char type = d->d_type;
+				off += d->d_reclen;
+
+				if (d->d_name[0] == '.' && (d->d_name[1] == '\0' ||
+				    (d->d_name[1] == '.' && d->d_name[2] == '\0')))
+					continue;
+
+				if (type == DT_UNKNOWN) {
+					struct stat st;
+					if (fstatat(dfd, d->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1)
+						continue;
+					type = S_ISREG(st.st_mode) ? DT_REG :
+					       S_ISDIR(st.st_mode) ? DT_DIR : DT_UNKNOWN;
+				}
+				if (type != DT_REG && type != DT_DIR)
+					continue;
+
+				if (type == DT_REG) {
+					struct finder_file *file = new_file(dir, dfd, d->d_name, idx);
+					ok = file != NULL && queue_push(q, file);
+					if (!ok)
+						free(file);
+					continue;
+				}
+
+				char *path = join_path(dir, d->d_name);
+				if (path == NULL) {
+					ok = false;
+					break;
+				}
+				if (depth == capacity) {
+					char **grown = realloc(stack, capacity * 2 * sizeof(*stack));
+					if (grown == NULL) {
+						free(path);
+						ok = false;
+						break;
+					}
+					stack = grown;
+					capacity *= 2;
+				}
+				stack[depth++] = path;
+			}
+		}
+		if (n == -1)
+			fprintf(stderr, "finder: %s: %s\n", dir, strerror(errno));
+		close(dfd);
+		free(dir);
+	}
+
+	while (depth > 0)
+		free(stack[--depth]);
+	free(stack);
+	free(dents);
+	return ok;
+}
+
+static unsigned int worker_count(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (n < 1)
+		return 1;
+	return n > MAX_WORKERS ? MAX_WORKERS : n;
+}
+
+int main(int argc, char **argv)
+{
+	const char *index_path = NULL;
+	int opt;
+
+	// '+' stops at the first operand, so search strings may start with '-'
+	while ((opt = getopt(argc, argv, "+i:")) != -1) {
+		switch (opt) {
+		case 'i':
+			index_path = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-i indexfile] filesdir searchstr\n", argv[0]);
+			return 1;
+		}
+	}
+	if (argc - optind != 2) {
+		printf("Incorrect number of arguments\n");
+		return 1;
+	}
+	const char *filesdir = argv[optind];
+	const char *searchstr = argv[optind + 1];
+	if (filesdir[0] == '\0') {
+		printf("null argument 1, expected filesdir\n");
+		return 1;
+	}
+	struct stat st;
+	if (stat(filesdir, &st) == -1 || !S_ISDIR(st.st_mode)) {
+		printf("%s is not a directory\n", filesdir);
+		return 1;
+	}
+	if (searchstr[0] == '\0') {
+		printf("null argument 2, expected searchstr\n");
+		return 1;
+	}
+
+	struct matcher matcher = {
+		.needle = searchstr,
+		.needle_len = strlen(searchstr),
+		.use_regex = !is_fixed_string(searchstr),
+	};
+	if (matcher.use_regex) {
+		int rc = regcomp(&matcher.re, searchstr, REG_NOSUB);
+		if (rc != 0) {
+			char err[256];
+			regerror(rc, &matcher.re, err, sizeof(err));
+			fprintf(stderr, "finder: %s\n", err);
+			return 2;
+		}
+	}
+
+	struct finder_index *idx = NULL;
+	struct timespec started;
+	if (index_path != NULL) {
+		idx = finder_index_load(index_path, searchstr);
+		if (idx == NULL) {
+			fprintf(stderr, "finder: out of memory\n");
+			return 1;
+		}
+		// file timestamps come from the coarse clock, so compare against it
+		clock_gettime(CLOCK_REALTIME_COARSE, &started);
+	}
+
+	struct file_queue queue = {
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+		.cond = PTHREAD_COND_INITIALIZER,
+	};
+	unsigned int nworkers = worker_count();
+	struct worker *workers = calloc(nworkers, sizeof(*workers));
+	if (workers == NULL) {
+		perror("finder");
+		return 1;
+	}
+
+	unsigned int nstarted = 0;
+	for (; nstarted < nworkers; nstarted++) {
+		workers[nstarted].queue = &queue;
+		workers[nstarted].matcher = &matcher;
+		if (pthread_create(&workers[nstarted].thread, NULL, search_worker,
+				   &workers[nstarted]) != 0)
+			break;
+	}
+	if (nstarted == 0) {
+		fprintf(stderr, "finder: could not start worker threads\n");
+		return 1;
+	}
+
+	bool ok = walk_tree(filesdir, &queue, idx);
+	queue_finish(&queue);
+
+	for (unsigned int i = 0; i < nstarted; i++) {
+		pthread_join(workers[i].thread, NULL);
+		free(workers[i].readbuf);
+		free(workers[i].scratch);
+	}
+	free(workers);
+
+	unsigned long nfiles = queue.count;
+	unsigned long nlines = 0;
+	for (size_t i = 0; i < queue.count; i++)
+		if (queue.files[i]->matches > 0)
+			nlines += queue.files[i]->matches;
+
+	if (ok && idx != NULL)
+		finder_index_save(idx, index_path, queue.files, queue.count,
+				  started.tv_sec * 1000000000LL + started.tv_nsec);
+	finder_index_free(idx);
+	for (size_t i = 0; i < queue.count; i++)
+		free(queue.files[i]);
+	free(queue.files);
+	if (!ok) {
+		fprintf(stderr, "finder: out of memory\n");
+		return 1;
+	}
+
+	// find without -H does not descend into a starting point that is a symlink
+	if (lstat(filesdir, &st) == 0 && S_ISLNK(st.st_mode))
+		nfiles = 0;
+
+	printf("The number of files are %lu and the number of matching lines are %lu\n",
+	       nfiles, nlines);
+	return 0;
+}
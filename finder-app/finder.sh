@@ -25,6 +25,12 @@ else
     searchstr="$2"
 fi
 
+# prefer the native finder, which walks the tree once and, when
+# FINDER_INDEX names an index file, skips files unchanged since last run
+if command -v finder >/dev/null 2>&1; then
+    exec finder ${FINDER_INDEX:+-i "$FINDER_INDEX"} -- "$filesdir" "$searchstr"
+fi
+
 # count files
 numfiles=`find $filesdir -type f|wc -l`
 
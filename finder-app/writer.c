@@ -1,32 +1,151 @@
 /* given 2 args, first is file, second is string,
-   write string to file */
+   write string to file
 
+   writer -b [-0] [manifest] instead writes many files in one process.
+   Each record is a path and the string to write to it, read from the
+   manifest or stdin: "path<TAB>string" lines by default, or with -0
+   NUL-terminated path and string fields so the string may hold any
+   byte but NUL. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
 #include <stdio.h>
-#include <syslog.h>
+#include <stdlib.h>
 #include <string.h>
-#include <stdio.h>
-#include <errno.h>
+#include <syslog.h>
+#include <unistd.h>
 
-int main(int argc, char **argv) {
-	openlog(NULL, LOG_PERROR||LOG_PID, LOG_USER);
+/* writes len bytes of buf to path, replacing any previous contents */
+static bool write_file(const char *path, const char *buf, size_t len)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd == -1) {
+		syslog(LOG_USER|LOG_ERR, "could not open %s for writing: %s", path, strerror(errno));
+		return false;
+	}
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			syslog(LOG_USER|LOG_ERR, "could not write %s: %s", path, strerror(errno));
+			close(fd);
+			return false;
+		}
+		buf += n;
+		len -= n;
+	}
+	if (close(fd) == -1) {
+		syslog(LOG_USER|LOG_ERR, "could not write %s: %s", path, strerror(errno));
+		return false;
+	}
+	return true;
+}
 
-	if (argc != 3) {
-		syslog(LOG_USER||LOG_ERR, "wrong number of args provided. Expected 3, got %d", argc);
+/**
+ * Writes every record read from @param fp, reusing one line buffer for
+ * all of them. @param nul_separated selects the -0 record format.
+ * @return the number of records that could not be written.
+ */
+static unsigned long write_batch(FILE *fp, bool nul_separated)
+{
+	char *line = NULL, *content = NULL;
+	size_t line_size = 0, content_size = 0;
+	unsigned long written = 0, failed = 0;
+	ssize_t len;
+
+	while ((len = getdelim(&line, &line_size, nul_separated ? '\0' : '\n', fp)) != -1) {
+		const char *str;
+		size_t str_len;
+
+		if (nul_separated) {
+			ssize_t clen = getdelim(&content, &content_size, '\0', fp);
+			if (clen == -1) {
+				syslog(LOG_USER|LOG_ERR, "no string for %s", line);
+				failed++;
+				break;
+			}
+			str = content;
+			str_len = content[clen - 1] == '\0' ? clen - 1 : clen;
+		} else {
+			if (line[len - 1] == '\n')
+				line[--len] = '\0';
+			if (len == 0)
+				continue;
+			char *tab = memchr(line, '\t', len);
+			if (tab == NULL) {
+				syslog(LOG_USER|LOG_ERR, "malformed record, expected path<TAB>string: %s", line);
+				failed++;
+				continue;
+			}
+			*tab = '\0';
+			str = tab + 1;
+			str_len = line + len - str;
+		}
+
+		if (write_file(line, str, str_len))
+			written++;
+		else
+			failed++;
+	}
+
+	syslog(LOG_USER|LOG_DEBUG, "Wrote %lu files, %lu failed", written, failed);
+	free(line);
+	free(content);
+	return failed;
+}
+
+static int batch_main(int argc, char **argv)
+{
+	bool nul_separated = false;
+	FILE *fp = stdin;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b0")) != -1) {
+		switch (opt) {
+		case 'b':
+			break;
+		case '0':
+			nul_separated = true;
+			break;
+		default:
+			syslog(LOG_USER|LOG_ERR, "usage: writer -b [-0] [manifest]");
+			return 1;
+		}
+	}
+	if (argc - optind > 1) {
+		syslog(LOG_USER|LOG_ERR, "usage: writer -b [-0] [manifest]");
 		return 1;
 	}
+	if (optind < argc && strcmp(argv[optind], "-") != 0) {
+		fp = fopen(argv[optind], "r");
+		if (fp == NULL) {
+			syslog(LOG_USER|LOG_ERR, "could not open %s: %s", argv[optind], strerror(errno));
+			return 1;
+		}
+	}
+
+	unsigned long failed = write_batch(fp, nul_separated);
+	if (fp != stdin)
+		fclose(fp);
+	return failed ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+	openlog(NULL, LOG_PERROR|LOG_PID, LOG_USER);
 
-	char *file_name = strdup(argv[1]);
-	char *output_str = strdup(argv[2]);
+	if (argc >= 2 && strcmp(argv[1], "-b") == 0)
+		return batch_main(argc, argv);
 
-	FILE *fp = fopen(file_name, "w");
-	if (fp == NULL) {
-		char *err_msg = strerror(errno);
-		syslog(LOG_USER||LOG_ERR, "could not open %s for writing: %s", file_name, err_msg);
+	if (argc != 3) {
+		syslog(LOG_USER|LOG_ERR, "wrong number of args provided. Expected 3, got %d", argc);
 		return 1;
 	}
 
-	syslog(LOG_USER||LOG_DEBUG, "Writing %s to %s", output_str, file_name);
-	fprintf(fp, "%s", output_str);
-	fclose(fp);
-	return 0;
-}
\ No newline at end of file
+	const char *file_name = argv[1];
+	const char *output_str = argv[2];
+
+	syslog(LOG_USER|LOG_DEBUG, "Writing %s to %s", output_str, file_name);
+	return write_file(file_name, output_str, strlen(output_str)) ? 0 : 1;
+}
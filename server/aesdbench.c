@@ -0,0 +1,200 @@
+/*
+Load generator for aesdsocket.  Each thread opens connections in binary
+mode one after another and sends packets on them, timing each packet from
+send until its framed reply has been read in full.  Comparing runs of the
+same load against aesdsocket started with and without -a / -n shows what
+thread placement buys on a given machine; with -a here the load threads
+can be kept off the cpus the server was given.  With -n, thread i writes
+to channel bench-(i mod n) instead of the default channel.
+
+usage: aesdbench [-t threads] [-c conns] [-k packets] [-s size] [-a cpulist] [-n channels] [host [port]]
+*/
+
+#define _GNU_SOURCE // cpu_set_t
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "aesdsocket.h"
+#include "channels.h"
+#include "latency.h"
+#include "netclient.h"
+#include "placement.h"
+
+#define BENCH_MAX_THREADS 256
+
+struct bench_opts {
+	const char *host;
+	const char *port;
+	int conns;
+	int packets;
+	size_t size;
+	int channels;
+};
+
+struct bench_thread {
+	pthread_t tid;
+	const struct bench_opts *opts;
+	int index;
+	struct latency_log lat;
+	uint64_t reply_bytes;
+	unsigned long errors;
+};
+
+static void *bench_worker(void *arg) {
+	struct bench_thread *bt = arg;
+	const struct bench_opts *o = bt->opts;
+	char *frame = malloc(BIN_HDR_LEN + o->size);
+	char *scratch = malloc(CLIENT_SCRATCH_SIZE);
+
+	if (frame == NULL || scratch == NULL) {
+		fprintf(stderr, "Could not alloc mem for bench buffers\n");
+		bt->errors++;
+		goto out;
+	}
+	client_make_record(frame, o->size, 'b');
+	char opener[CHANNEL_PREFIX_LEN + CHANNEL_NAME_MAX + 1 + BIN_MAGIC_LEN + 1];
+	int opener_len = 0;
+	if (o->channels > 0) {
+		opener_len = snprintf(opener, sizeof(opener), CHANNEL_PREFIX "bench-%d\n", bt->index % o->channels);
+	}
+	memcpy(opener + opener_len, BIN_MAGIC, BIN_MAGIC_LEN);
+	opener_len += BIN_MAGIC_LEN;
+
+	for (int c = 0; c < o->conns; c++) {
+		int fd = client_connect(o->host, o->port);
+		if (fd == -1 || !client_send(fd, opener, opener_len)) {
+			bt->errors++;
+			if (fd != -1) {
+				close(fd);
+			}
+			continue;
+		}
+		for (int k = 0; k < o->packets; k++) {
+			uint64_t start = latency_now_ns();
+			if (!client_send(fd, frame, BIN_HDR_LEN + o->size)) {
+				bt->errors++;
+				break;
+			}
+			long n = client_read_reply(fd, scratch);
+			if (n < 0) {
+				bt->errors++;
+				break;
+			}
+			latency_add(&bt->lat, latency_now_ns() - start);
+			bt->reply_bytes += n;
+		}
+		close(fd);
+	}
+out:
+	free(frame);
+	free(scratch);
+	return NULL;
+}
+
+int main(int argc, char **argv) {
+	struct bench_opts o = {.host = "localhost", .port = PORT_NUM, .conns = 50, .packets = 10, .size = 64};
+	int nthreads = 4;
+	char *cpulist = NULL;
+	cpu_set_t cpus;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:c:k:s:a:n:")) != -1) {
+		switch (opt) {
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		case 'c':
+			o.conns = atoi(optarg);
+			break;
+		case 'k':
+			o.packets = atoi(optarg);
+			break;
+		case 's':
+			o.size = strtoul(optarg, NULL, 10);
+			break;
+		case 'a':
+			cpulist = optarg;
+			break;
+		case 'n':
+			o.channels = atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind < argc) {
+		o.host = argv[optind++];
+	}
+	if (optind < argc) {
+		o.port = argv[optind++];
+	}
+	if (optind < argc || nthreads < 1 || nthreads > BENCH_MAX_THREADS || o.conns < 1 ||
+	    o.packets < 1 || o.size < 1 || o.size > BIN_MAX_FRAME || o.channels < 0 || o.channels > CHANNEL_MAX) {
+		goto usage;
+	}
+	if (cpulist != NULL && (placement_parse_cpulist(cpulist, &cpus) != 0 || CPU_COUNT(&cpus) == 0)) {
+		fprintf(stderr, "Bad cpu list: %s\n", cpulist);
+		exit(EXIT_FAILURE);
+	}
+
+	struct bench_thread *bt = calloc(nthreads, sizeof(*bt));
+	if (bt == NULL) {
+		fprintf(stderr, "Could not alloc mem for threads\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// thread i goes on the i-th listed cpu, wrapping around the list
+	int cpu = -1;
+	uint64_t start = latency_now_ns();
+	for (int i = 0; i < nthreads; i++) {
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		if (cpulist != NULL) {
+			cpu_set_t one;
+			do {
+				cpu = (cpu + 1) % CPU_SETSIZE;
+			} while (!CPU_ISSET(cpu, &cpus));
+			CPU_ZERO(&one);
+			CPU_SET(cpu, &one);
+			pthread_attr_setaffinity_np(&attr, sizeof(one), &one);
+		}
+		bt[i].opts = &o;
+		bt[i].index = i;
+		int err = pthread_create(&bt[i].tid, &attr, bench_worker, &bt[i]);
+		pthread_attr_destroy(&attr);
+		if (err != 0) {
+			fprintf(stderr, "Could not start thread: %s\n", strerror(err));
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	struct latency_log all = {0};
+	uint64_t reply_bytes = 0;
+	unsigned long errors = 0;
+	for (int i = 0; i < nthreads; i++) {
+		pthread_join(bt[i].tid, NULL);
+		latency_merge(&all, &bt[i].lat);
+		latency_free(&bt[i].lat);
+		reply_bytes += bt[i].reply_bytes;
+		errors += bt[i].errors;
+	}
+	double secs = (latency_now_ns() - start) / 1e9;
+
+	printf("%d threads, %d connections, %zu packets in %.3f s: %.0f conn/s, %.0f packets/s, %.1f MB/s of replies, %lu errors\n",
+	       nthreads, nthreads * o.conns, all.count, secs, nthreads * o.conns / secs,
+	       all.count / secs, reply_bytes / secs / 1e6, errors);
+	latency_report(&all, "latency", stdout);
+	latency_free(&all);
+	free(bt);
+	return errors == 0 ? 0 : 1;
+
+usage:
+	fprintf(stderr, "usage: %s [-t threads] [-c conns] [-k packets] [-s size] [-a cpulist] [-n channels] [host [port]]\n", argv[0]);
+	exit(EXIT_FAILURE);
+}
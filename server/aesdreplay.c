@@ -0,0 +1,304 @@
+/*
+Replays a trace captured with aesdsocket -C against a server.  Every
+connection in the trace is opened at its recorded time, divided by the
+speed factor, and sends packets of the recorded sizes at their recorded
+times, each packet waiting for its reply before the next goes out.  Every
+connection is replayed in binary mode, since only framed replies show
+where one reply ends and the next begins; segment mode connections stay
+in segment mode, and connections that selected a channel select it
+again.  The report gives the reply latency percentiles and how
+late sends went out against the schedule, which shows whether the
+server, or this tool, kept up.
+
+usage: aesdreplay [-x speed] tracefile [host [port]]
+       speed 1 replays in real time, 2 twice as fast, 0 without any pauses
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "aesdsocket.h"
+#include "channels.h"
+#include "latency.h"
+#include "netclient.h"
+#include "threadreg.h"
+#include "trace.h"
+
+#define REPLAY_THREAD_STACK_SIZE (256 * 1024)
+
+struct replay_packet {
+	uint64_t at_us;
+	uint32_t size;
+};
+
+struct replay_conn {
+	uint64_t open_us;
+	uint64_t close_us;
+	int mode;
+	char channel[CHANNEL_NAME_MAX + 1];	// empty for the default channel
+	bool closed;
+	struct replay_packet *packets;
+	size_t npackets;
+	size_t cap;
+	size_t max_size;
+};
+
+struct replay {
+	const char *host;
+	const char *port;
+	double speed;
+	uint64_t start_ns;
+	struct replay_conn *conns;
+	size_t nconns;
+	pthread_mutex_t lock;	// guards the totals below
+	struct latency_log lat;
+	struct latency_log lag;
+	uint64_t npackets;
+	unsigned long errors;
+};
+
+static struct replay rp = {.port = PORT_NUM, .host = "localhost", .speed = 1.0,
+			   .lock = PTHREAD_MUTEX_INITIALIZER};
+
+static int add_packet(struct replay_conn *rc, uint64_t at_us, uint64_t size) {
+	if (size > BIN_MAX_FRAME) {
+		return -1;
+	}
+	if (rc->npackets == rc->cap) {
+		size_t cap = rc->cap ? rc->cap * 2 : 16;
+		struct replay_packet *p = realloc(rc->packets, cap * sizeof(*p));
+		if (p == NULL) {
+			return -1;
+		}
+		rc->packets = p;
+		rc->cap = cap;
+	}
+	rc->packets[rc->npackets].at_us = at_us;
+	rc->packets[rc->npackets].size = size;
+	rc->npackets++;
+	if (size > rc->max_size) {
+		rc->max_size = size;
+	}
+	return 0;
+}
+
+// reads the whole trace into per-connection schedules. returns 0 or -1.
+static int load_trace(const char *path) {
+	struct trace_event ev = {0};
+	size_t cap = 0;
+	int r;
+
+	FILE *fp = fopen(path, "r");
+	if (fp == NULL) {
+		fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	if (trace_read_header(fp) != 0) {
+		fprintf(stderr, "%s is not a trace\n", path);
+		fclose(fp);
+		return -1;
+	}
+	while ((r = trace_read_event(fp, &ev)) == 1) {
+		if (ev.type == TRACE_OPEN) {
+			// ids are handed out in order, so a new one is always the next
+			if (ev.conn != rp.nconns) {
+				break;
+			}
+			if (rp.nconns == cap) {
+				cap = cap ? cap * 2 : 256;
+				struct replay_conn *conns = realloc(rp.conns, cap * sizeof(*conns));
+				if (conns == NULL) {
+					break;
+				}
+				rp.conns = conns;
+			}
+			memset(&rp.conns[rp.nconns], 0, sizeof(*rp.conns));
+			rp.conns[rp.nconns].open_us = ev.time_us;
+			rp.nconns++;
+			continue;
+		}
+		if (ev.conn >= rp.nconns) {
+			break;
+		}
+		struct replay_conn *rc = &rp.conns[ev.conn];
+		if (ev.type == TRACE_MODE) {
+			rc->mode = ev.arg;
+		} else if (ev.type == TRACE_CHANNEL) {
+			strcpy(rc->channel, ev.channel);
+		} else if (ev.type == TRACE_PACKET) {
+			if (add_packet(rc, ev.time_us, ev.arg) != 0) {
+				break;
+			}
+		} else {
+			rc->close_us = ev.time_us;
+			rc->closed = true;
+		}
+	}
+	// a server that was killed leaves its last record cut short
+	bool truncated = r == -1 && feof(fp);
+	fclose(fp);
+	if (truncated) {
+		fprintf(stderr, "%s ends in a partial record, replaying what came before it\n", path);
+	} else if (r != 0) {
+		fprintf(stderr, "%s is damaged\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+// sleeps until trace time at_us, as scaled by the speed factor, and
+// returns how late that moment already was
+static uint64_t wait_until(uint64_t at_us) {
+	if (rp.speed == 0) {
+		return 0;
+	}
+	uint64_t due = rp.start_ns + (uint64_t)(at_us * 1000 / rp.speed);
+	uint64_t now = latency_now_ns();
+	if (now >= due) {
+		return now - due;
+	}
+	struct timespec ts = {.tv_sec = due / 1000000000, .tv_nsec = due % 1000000000};
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+	}
+	return 0;
+}
+
+static void *replay_conn(void *arg) {
+	struct replay_conn *rc = arg;
+	struct latency_log lat = {0}, lag = {0};
+	unsigned long errors = 0;
+	size_t sent = 0;
+	char *record = malloc(BIN_HDR_LEN + (rc->max_size ? rc->max_size : 1));
+	char *scratch = malloc(CLIENT_SCRATCH_SIZE);
+	int fd = -1;
+
+	if (record == NULL || scratch == NULL) {
+		errors++;
+		goto out;
+	}
+	char opener[CHANNEL_PREFIX_LEN + CHANNEL_NAME_MAX + 1 + BIN_MAGIC_LEN + 1];
+	int opener_len = 0;
+	if (*rc->channel) {
+		opener_len = snprintf(opener, sizeof(opener), CHANNEL_PREFIX "%s\n", rc->channel);
+	}
+	memcpy(opener + opener_len, rc->mode == TRACE_MODE_SEGMENTS ? BIN_Z_MAGIC : BIN_MAGIC, BIN_MAGIC_LEN);
+	opener_len += BIN_MAGIC_LEN;
+
+	fd = client_connect(rp.host, rp.port);
+	if (fd == -1 || !client_send(fd, opener, opener_len)) {
+		fprintf(stderr, "connection %zu: could not connect: %s\n", (size_t)(rc - rp.conns), strerror(errno));
+		errors++;
+		goto out;
+	}
+	for (; sent < rc->npackets; sent++) {
+		struct replay_packet *p = &rc->packets[sent];
+		latency_add(&lag, wait_until(p->at_us));
+		client_make_record(record, p->size, 'r');
+		uint64_t start = latency_now_ns();
+		if (!client_send(fd, record, BIN_HDR_LEN + p->size) || client_read_reply(fd, scratch) < 0) {
+			fprintf(stderr, "connection %zu: lost after %zu packets: %s\n", (size_t)(rc - rp.conns), sent,
+				errno ? strerror(errno) : "closed by server");
+			errors++;
+			break;
+		}
+		latency_add(&lat, latency_now_ns() - start);
+	}
+	if (rc->closed) {
+		wait_until(rc->close_us);
+	}
+
+out:
+	if (fd != -1) {
+		close(fd);
+	}
+	free(record);
+	free(scratch);
+	pthread_mutex_lock(&rp.lock);
+	rp.npackets += lat.count;
+	latency_merge(&rp.lat, &lat);
+	latency_merge(&rp.lag, &lag);
+	rp.errors += errors;
+	pthread_mutex_unlock(&rp.lock);
+	latency_free(&lat);
+	latency_free(&lag);
+	return NULL;
+}
+
+int main(int argc, char **argv) {
+	struct thread_registry threads;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "x:")) != -1) {
+		switch (opt) {
+		case 'x':
+			rp.speed = strtod(optarg, NULL);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind >= argc || rp.speed < 0) {
+		goto usage;
+	}
+	const char *path = argv[optind++];
+	if (optind < argc) {
+		rp.host = argv[optind++];
+	}
+	if (optind < argc) {
+		rp.port = argv[optind++];
+	}
+	if (optind < argc) {
+		goto usage;
+	}
+
+	if (load_trace(path) != 0) {
+		exit(EXIT_FAILURE);
+	}
+	int err = thread_registry_init(&threads, REPLAY_THREAD_STACK_SIZE);
+	if (err != 0) {
+		fprintf(stderr, "Could not start thread registry: %s\n", strerror(err));
+		exit(EXIT_FAILURE);
+	}
+
+	uint64_t span_us = 0;
+	rp.start_ns = latency_now_ns();
+	for (size_t i = 0; i < rp.nconns; i++) {
+		struct replay_conn *rc = &rp.conns[i];
+		wait_until(rc->open_us);
+		err = thread_registry_spawn(&threads, replay_conn, rc);
+		if (err != 0) {
+			fprintf(stderr, "Could not start thread: %s\n", strerror(err));
+			rp.errors++;
+		}
+		uint64_t end = rc->closed ? rc->close_us : rc->npackets ? rc->packets[rc->npackets - 1].at_us : rc->open_us;
+		if (end > span_us) {
+			span_us = end;
+		}
+	}
+	thread_registry_destroy(&threads);
+	double secs = (latency_now_ns() - rp.start_ns) / 1e9;
+
+	printf("replayed %zu connections, %llu packets in %.3f s (trace spans %.3f s, speed %gx), %lu errors\n",
+	       rp.nconns, (unsigned long long)rp.npackets, secs, span_us / 1e6, rp.speed, rp.errors);
+	latency_report(&rp.lat, "reply latency", stdout);
+	latency_report(&rp.lag, "send lag", stdout);
+
+	for (size_t i = 0; i < rp.nconns; i++) {
+		free(rp.conns[i].packets);
+	}
+	free(rp.conns);
+	latency_free(&rp.lat);
+	latency_free(&rp.lag);
+	return rp.errors == 0 ? 0 : 1;
+
+usage:
+	fprintf(stderr, "usage: %s [-x speed] tracefile [host [port]]\n", argv[0]);
+	exit(EXIT_FAILURE);
+}
@@ -30,177 +30,418 @@
 */
 
 /*
-Make helpers for mutex around linked list.
-Make each thread update their own entry in thread tracking list
-  when finished before returning.
-Can do that by calling function ch_worker_done(&chh, tid) which marks as finished;
-Make helper thread that loops over linked list every N seconds and joins finished threads.
+Client handler threads are started through a thread registry (threadreg.c).
+Each thread queues itself on a completion queue when it returns, and the
+registry's reaper joins it and keeps its bookkeeping for the next thread.
+The state a connection needs comes from a connection pool (connpool.c),
+so a server that has warmed up serves connections without allocating.
+Thread placement on cpus and NUMA nodes is set up by placement.c.
+A client may pick which history it works on by naming a channel (channels.c).
 */
 
+#define _GNU_SOURCE // cpu_set_t, pthread_attr_setaffinity_np
 #include <stdio.h>
 #include <string.h>
 #include <syslog.h>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
-#include <sys/queue.h>
 #include <netdb.h>
 #include <unistd.h>
 #include <errno.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <pthread.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
 
 #include "aesdsocket.h"
 #include "timestamp.h"
 #include "helpers.h"
+#include "threadreg.h"
+#include "handoff.h"
+#include "worklog.h"
+#include "connpool.h"
+#include "placement.h"
+#include "trace.h"
+#include "channels.h"
 
 #define TIMESTAMP_INTERVAL 10
-#define CH_THREAD_REAP_INTERVAL 1
-#define ADDR_BUF_SIZE INET6_ADDRSTRLEN + 1
+#define CH_THREAD_STACK_SIZE (256 * 1024)
+#define HANDOFF_RETRY_MS 1000
+#define HANDOFF_DRAIN_MS 5000
 
 bool cease = false;
-pthread_mutex_t work_file_lock = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t ch_thread_status_lock = PTHREAD_MUTEX_INITIALIZER;
+int shutdown_fd = -1;
+int stats_fd = -1;
+static bool coalesce_replies = false;
+static struct trace *capture = NULL;
+static struct channel_table channels;
 
-struct ch_worker_args {
-	FILE *fp;
-	char client_addr[ADDR_BUF_SIZE]; 
-	int conn_fd;
-};
+struct thread_registry ch_threads;
 
-struct ch_entry {
-	pthread_t tid;
-	bool finished;
-	SLIST_ENTRY(ch_entry) ch_entries;
-};
+// makes room for at least want more bytes. the buffer grows to exactly
+// what is needed, so a binary record lands in a right-sized buffer.
+static bool conn_buf_reserve(struct conn *c, size_t want) {
+	struct conn_buf *b = &c->in;
 
-SLIST_HEAD(ch_head, ch_entry);
-struct ch_head chh;	
-
-void *ch_thread_reaper(void *ch_thread_reaper) {
-	pthread_t pid = pthread_self();
-	fprintf(stderr, "Started client handler thread reaper with PID %lu\n", pid);
+	if (b->cap - b->len >= want) {
+		return true;
+	}
+	char *data = realloc(b->data, b->len + want);
+	if (data == NULL) {
+		syslog(LOG_USER|LOG_ERR, "Could not alloc mem for recv buffer: %s", strerror(errno));
+		return false;
+	}
+	b->data = data;
+	b->cap = b->len + want;
+	c->buf_grown++;
+	return true;
+}
 
-	struct ch_entry *entry, *ch_temp;
-	
-	while (cease == false) {
-		sleep(CH_THREAD_REAP_INTERVAL);
+// receives up to want more bytes onto the end of the buffer. returns
+// recv's result, or -1 if the buffer could not grow or we are shutting
+// down with nothing more queued. waits in poll alongside shutdown_fd, so
+// shutdown never waits on an idle client. when capturing, notes the time
+// the bytes arrived for the packets they complete.
+static ssize_t conn_buf_recv(struct conn *c, size_t want) {
+	struct conn_buf *b = &c->in;
+	struct pollfd pfds[2] = {
+		{.fd = c->conn_fd, .events = POLLIN},
+		{.fd = shutdown_fd, .events = POLLIN},
+	};
+	ssize_t n;
+
+	if (!conn_buf_reserve(c, want)) {
+		return -1;
+	}
+	while ((n = recv(c->conn_fd, b->data + b->len, want, MSG_DONTWAIT)) < 0) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+			return -1;
+		}
+		if (cease) {
+			return -1;
+		}
+		// on shutdown, go round once more for what arrived meanwhile
+		if (poll(pfds, 2, -1) == -1 && errno != EINTR) {
+			return -1;
+		}
+	}
+	if (capture != NULL) {
+		c->recv_us = trace_clock_us();
+	}
+	b->len += n;
+	return n;
+}
 
-		// walk thread list and cleanup here
-		pthread_mutex_lock(&ch_thread_status_lock);
+// drops the first n bytes, keeping whatever follows for the next packet
+static void conn_buf_consume(struct conn_buf *b, size_t n) {
+	memmove(b->data, b->data + n, b->len - n);
+	b->len -= n;
+}
 
-		SLIST_FOREACH_SAFE(entry, &chh, ch_entries, ch_temp) {
-			if (entry->finished == true) {
-				SLIST_REMOVE(&chh, entry, ch_entry, ch_entries);
-				syslog(LOG_USER||LOG_INFO, "CH thread reaper cleaned up %lu", entry->tid);
-				free(entry);
-			}
+static bool batch_add(struct packet_batch *pb, char *base, size_t len) {
+	if (pb->count == pb->cap) {
+		size_t cap = pb->cap ? pb->cap * 2 : 8;
+		struct iovec *iov = realloc(pb->iov, cap * sizeof(*iov));
+		if (iov == NULL) {
+			syslog(LOG_USER|LOG_ERR, "Could not alloc mem for packet batch: %s", strerror(errno));
+			return false;
 		}
-
-		pthread_mutex_unlock(&ch_thread_status_lock);
+		pb->iov = iov;
+		pb->cap = cap;
 	}
+	pb->iov[pb->count].iov_base = base;
+	pb->iov[pb->count].iov_len = len;
+	pb->count++;
+	return true;
+}
 
-	return((void *)0);
+// stores the batch and answers it in order. each packet is answered with
+// the history as of that packet, so it is appended on its own just before
+// its reply. when coalescing, the whole batch is stored under one lock
+// acquisition and answered once. returns false once the client can no
+// longer be answered.
+static bool commit_batch(struct conn *c, enum work_log_reply reply) {
+	struct packet_batch *pb = &c->pb;
+	size_t step = coalesce_replies ? pb->count : 1;
+	bool ok = true;
+
+	for (size_t i = 0; ok && i < pb->count; i += step) {
+		work_log_append(c->log, pb->iov + i, step);
+		if (capture != NULL) {
+			trace_packets(capture, c->trace_id, c->recv_us, pb->iov + i, step);
+		}
+		for (size_t j = i; j < i + step; j++) {
+			conn_note_packet(c, pb->iov[j].iov_len);
+		}
+		ok = work_log_send(c->log, &c->reader, c->conn_fd, reply);
+	}
+	pb->count = 0;
+	return ok;
 }
 
-void ch_reaper_new_thread(pthread_t tid) {
-	struct ch_entry *ch = malloc(sizeof(struct ch_entry));
-	ch->finished = false;
-	ch->tid = tid;
+// splits the buffered bytes into complete packets. returns how many bytes
+// they span, or -1 if a binary header announces an oversized record.
+// *want is set to the bytes still missing from a partial binary record.
+static ssize_t collect_packets(struct conn *c, bool binary, size_t *want) {
+	struct conn_buf *in = &c->in;
+	struct packet_batch *pb = &c->pb;
+	size_t off = 0;
+
+	*want = 0;
+	while (off < in->len) {
+		if (!binary) {
+			char *nl = memchr(in->data + off, '\n', in->len - off);
+			if (nl == NULL) {
+				break;
+			}
+			size_t len = nl + 1 - (in->data + off);
+			if (!batch_add(pb, in->data + off, len)) {
+				return -1;
+			}
+			off += len;
+			continue;
+		}
 
-	pthread_mutex_lock(&ch_thread_status_lock);
-	SLIST_INSERT_HEAD(&chh, ch, ch_entries);
-	pthread_mutex_unlock(&ch_thread_status_lock);
+		if (in->len - off < BIN_HDR_LEN) {
+			break;
+		}
+		uint32_t len = get_frame_len((unsigned char *)in->data + off);
+		if (len > BIN_MAX_FRAME) {
+			syslog(LOG_USER|LOG_ERR, "Record of %u bytes from %s exceeds limit", len, c->client_addr);
+			return -1;
+		}
+		if (in->len - off - BIN_HDR_LEN < len) {
+			*want = BIN_HDR_LEN + len - (in->len - off);
+			break;
+		}
+		if (!batch_add(pb, in->data + off + BIN_HDR_LEN, len)) {
+			return -1;
+		}
+		off += BIN_HDR_LEN + len;
+	}
+	return off;
 }
 
-void ch_reaper_mark_finished() {
-	pthread_t tid = pthread_self();
-	struct ch_entry *entry;
+// reads the optional CHANNEL_PREFIX line and picks the connection's log.
+// like the magic check, this stops waiting as soon as the bytes stop
+// matching the prefix. returns NULL if the line is malformed or names a
+// channel that cannot be opened.
+static struct work_log *select_channel(struct conn *c, bool *eof) {
+	struct conn_buf *in = &c->in;
+	char name[CHANNEL_NAME_MAX + 1];
+	char *nl = NULL;
+
+	while (in->len < CHANNEL_PREFIX_LEN && (in->len == 0 || memcmp(in->data, CHANNEL_PREFIX, in->len) == 0)) {
+		ssize_t n = conn_buf_recv(c, NET_BUF_SIZE);
+		if (n <= 0) {
+			*eof = n == 0;
+			break;
+		}
+	}
+	if (in->len < CHANNEL_PREFIX_LEN || memcmp(in->data, CHANNEL_PREFIX, CHANNEL_PREFIX_LEN) != 0) {
+		return channels_get(&channels, "");
+	}
 
-	pthread_mutex_lock(&ch_thread_status_lock);
-	SLIST_FOREACH(entry, &chh, ch_entries) {
-		if (entry->tid == tid) {
-			entry->finished = true;
+	while ((nl = memchr(in->data, '\n', in->len)) == NULL && in->len <= CHANNEL_PREFIX_LEN + CHANNEL_NAME_MAX) {
+		ssize_t n = conn_buf_recv(c, NET_BUF_SIZE);
+		if (n <= 0) {
+			*eof = n == 0;
 			break;
 		}
 	}
-	pthread_mutex_unlock(&ch_thread_status_lock);
+	size_t len = nl == NULL ? 0 : nl - (in->data + CHANNEL_PREFIX_LEN);
+	if (nl == NULL || len > CHANNEL_NAME_MAX) {
+		syslog(LOG_USER|LOG_ERR, "Bad channel line from %s", c->client_addr);
+		return NULL;
+	}
+	memcpy(name, in->data + CHANNEL_PREFIX_LEN, len);
+	name[len] = '\0';
+	if (!channel_name_valid(name)) {
+		syslog(LOG_USER|LOG_ERR, "Bad channel name from %s", c->client_addr);
+		return NULL;
+	}
+	conn_buf_consume(in, nl + 1 - in->data);
+	if (capture != NULL) {
+		trace_conn_channel(capture, c->trace_id, name);
+	}
+	return channels_get(&channels, name);
 }
 
-void *handle_conn(void *ch_void) {
-	struct ch_worker_args ch = *(struct ch_worker_args *)ch_void;
+// serves packets on one connection until the client closes it. packets
+// that arrive together are committed together and their replies are sent
+// back in the order the packets came in.
+void *handle_conn(void *conn_void) {
+	struct conn *c = conn_void;
+	struct conn_buf *in = &c->in;
+	enum work_log_reply reply = WORK_LOG_RAW;
+	bool eof = false;
 
-	char *out_buf; // what we'll write to file
-	char *recv_buf; // what we're working with while reading from sock
+	conn_fit_buffer(c);
 
-	recv_buf = malloc(NET_BUF_SIZE + 1);
-	if (recv_buf == NULL) {
-		char *err_msg = strerror(errno);
-		fprintf(stderr, "Could not alloc mem for recv buffer: %s\n", err_msg);
-		exit(EXIT_FAILURE);
-	}
+	// replies are already batched with MSG_MORE; don't let Nagle hold the tail
+	int one = 1;
+	setsockopt(c->conn_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
 
-	int bytes_read = 0;
-	int outbuf_size = 0;
-	while (true) {
-		bytes_read = recv(ch.conn_fd, recv_buf, NET_BUF_SIZE + 1, 0);
+	c->log = select_channel(c, &eof);
+	if (c->log == NULL) {
+		goto done;
+	}
 
-		if (bytes_read <= 0) {
-			fprintf(stderr, "read nothing, must be finished\n");
+	// a newline client's bytes stop matching the magics by its first
+	// newline at the latest, so this never waits on a complete packet.
+	// the two magics differ only in their last byte.
+	while (in->len < BIN_MAGIC_LEN &&
+	       (in->len == 0 || memcmp(in->data, BIN_MAGIC, in->len < BIN_MAGIC_LEN - 1 ? in->len : BIN_MAGIC_LEN - 1) == 0)) {
+		ssize_t n = conn_buf_recv(c, NET_BUF_SIZE);
+		if (n <= 0) {
+			eof = n == 0;
 			break;
 		}
+	}
+	if (in->len >= BIN_MAGIC_LEN && memcmp(in->data, BIN_MAGIC, BIN_MAGIC_LEN) == 0) {
+		reply = WORK_LOG_FRAMED;
+	} else if (in->len >= BIN_MAGIC_LEN && memcmp(in->data, BIN_Z_MAGIC, BIN_MAGIC_LEN) == 0) {
+		reply = WORK_LOG_SEGMENTS;
+	}
+	bool binary = reply != WORK_LOG_RAW;
+	if (capture != NULL) {
+		trace_conn_mode(capture, c->trace_id,
+				reply == WORK_LOG_FRAMED ? TRACE_MODE_FRAMED :
+				reply == WORK_LOG_SEGMENTS ? TRACE_MODE_SEGMENTS : TRACE_MODE_TEXT);
+	}
+	if (binary) {
+		conn_buf_consume(in, BIN_MAGIC_LEN);
+	}
 
-		recv_buf[bytes_read] = '\0';
-		fprintf(stderr, "read %d char: %s\n", bytes_read, recv_buf);
-
-		if (outbuf_size == 0) { // init buf if first time
-			outbuf_size = bytes_read;
-			out_buf = malloc(outbuf_size + 1);
-			if (out_buf == NULL) {
-				char *err_msg = strerror(errno);
-				fprintf(stderr, "Could not alloc mem for out buffer: %s\n", err_msg);
-				exit(EXIT_FAILURE);
-			}
-
-			strcpy(out_buf, recv_buf);
-		} else { // time to grow outbuf!
-			out_buf = realloc(out_buf, outbuf_size + bytes_read);
-			strcpy(out_buf + strlen(out_buf), recv_buf);
+	// once shutdown starts, what was already received is still committed
+	// and answered, but nothing more is waited for
+	for (;;) {
+		bool stopping = cease;
+		size_t want;
+		ssize_t used = collect_packets(c, binary, &want);
+		if (used < 0) {
+			break;
 		}
-		outbuf_size += bytes_read;
-
-		if (newline_in_buf(bytes_read, recv_buf) == true) {
-			fprintf(stderr, "found newline, done with this\n");
+		// an unterminated line at EOF is still stored, as it always was
+		if (eof && !binary && (size_t)used < in->len) {
+			batch_add(&c->pb, in->data + used, in->len - used);
+			used = in->len;
+		}
+		if (!commit_batch(c, reply)) {
+			break;
+		}
+		conn_buf_consume(in, used);
+		if (eof || stopping) {
 			break;
 		}
 
+		// with a record's length known, receive the rest of it directly
+		ssize_t n = conn_buf_recv(c, want > 0 ? want : NET_BUF_SIZE);
+		if (n < 0) {
+			break;
+		}
+		eof = n == 0;
+	}
 
+done:
+	close(c->conn_fd);
+	if (capture != NULL) {
+		trace_conn_close(capture, c->trace_id);
 	}
-	free(recv_buf);
+	syslog(LOG_USER|LOG_INFO, "Closed connection from %s", c->client_addr);
 
-	// flush to file
-	fprintf(stderr, "Got stuff: %s\n", out_buf);
-	write_buf_to_work_file(ch.fp, out_buf);
-	
-	free(out_buf);
-	
-	return_work_file_to_client(ch.fp, ch.conn_fd);
+	conn_pool_put(c);
+	return((void *)0);
+}
 
-	close(ch.conn_fd);
-	syslog(LOG_USER||LOG_INFO, "Closed connection from %s", ch.client_addr);
-	
-	ch_reaper_mark_finished();
 
-	free(ch_void);
-	pthread_exit((void *)0);
+// once warmed up, allocated and the thread entries stop growing
+static void log_alloc_stats(struct conn_pool *pools, int npools) {
+	pthread_mutex_lock(&ch_threads.lock);
+	unsigned long entries = ch_threads.allocated;
+	pthread_mutex_unlock(&ch_threads.lock);
+
+	for (int i = 0; i < npools; i++) {
+		struct conn_pool *pool = &pools[i];
+		struct conn_pool_stats *st = &pool->stats;
+		syslog(LOG_USER|LOG_INFO,
+		       "Allocation stats, pool %d: %lu connections, %lu conn objects allocated, %lu reused, %zu idle; "
+		       "recv buffers grown %lu, trimmed %lu, target %zu bytes",
+		       i, st->acquired, st->allocated, st->reused, pool->nidle,
+		       st->buf_grown, st->buf_trimmed, pool->buf_target);
+	}
+	syslog(LOG_USER|LOG_INFO, "Allocation stats: %lu thread entries allocated", entries);
 }
 
+int main(int argc, char **argv) {
+	bool daemonize = false;
+	bool take_over = false;
+	bool compress = false;
+	bool successor_waiting = false;
+	bool node_groups = false;
+	char *io_cpulist = NULL;
+	char *capture_path = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "dcrza:nC:")) != -1) {
+		switch (opt) {
+		case 'd':
+			printf("want daemon\n");
+			daemonize = true;
+			break;
+		case 'c':
+			coalesce_replies = true;
+			break;
+		case 'r':
+			take_over = true;
+			break;
+		case 'z':
+			compress = true;
+			break;
+		case 'a':
+			io_cpulist = optarg;
+			break;
+		case 'n':
+			node_groups = true;
+			break;
+		case 'C':
+			capture_path = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-d] [-c] [-r] [-z] [-a io-cpulist] [-n] [-C tracefile]\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	struct placement placement;
+	int err = placement_init(&placement, io_cpulist, node_groups);
+	if (err == -1) {
+		fprintf(stderr, "Bad cpu list for -a: %s\n", io_cpulist);
+		exit(EXIT_FAILURE);
+	} else if (err != 0) {
+		fprintf(stderr, "Could not get cpu affinity: %s\n", strerror(err));
+		exit(EXIT_FAILURE);
+	}
 
+	// opened before daemon() changes directory, so relative paths work
+	static struct trace trace;
+	if (capture_path != NULL) {
+		if (trace_open(&trace, capture_path) != 0) {
+			fprintf(stderr, "Could not create trace file %s: %s\n", capture_path, strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		capture = &trace;
+	}
 
-int main(int argc, char **argv) {
-	if (want_daemon(argc, argv) == true) {
+	if (daemonize) {
 		int daemon_err = daemon(0,0);
 		if (daemon_err < 0) {
 			fprintf(stderr, "failed to daemonize :(\n");
@@ -209,9 +450,42 @@ int main(int argc, char **argv) {
 	fprintf(stderr, "ready to work!\n");
 
 	// setup syslog
-	openlog(NULL, LOG_PERROR||LOG_PID, LOG_USER);
+	openlog(NULL, LOG_PERROR|LOG_PID, LOG_USER);
+
+	// every blocking wait also polls this, so shutdown is immediate
+	shutdown_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (shutdown_fd == -1) {
+		fprintf(stderr, "Could not create shutdown eventfd: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	// SIGUSR1 asks the accept loop to log allocation stats
+	stats_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (stats_fd == -1) {
+		fprintf(stderr, "Could not create stats eventfd: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
 
 	int sock_fd = -1;
+	FILE *fp = NULL;
+	if (take_over) {
+		int fds[2];
+		int release_fd = handoff_take(fds, 2);
+		if (release_fd != -1) {
+			// the predecessor is finishing its clients; start once
+			// it no longer writes the files
+			handoff_wait_release(release_fd);
+			sock_fd = fds[0];
+			fp = fdopen(fds[1], "a+");
+			if (fp == NULL) {
+				fprintf(stderr, "Could not open handed-off work file: %s\n", strerror(errno));
+				exit(EXIT_FAILURE);
+			}
+			syslog(LOG_USER|LOG_INFO, "Took over listening socket from running instance");
+		} else {
+			fprintf(stderr, "no running instance to take over, starting fresh\n");
+		}
+	}
+
 	while (sock_fd == -1) {
 		sock_fd = must_bind_port_fd(BACKLOG, PORT_NUM);
 
@@ -220,76 +494,219 @@ int main(int argc, char **argv) {
 			sleep(10);
 		}
 	}
+	// every process the socket was ever handed to may accept on it, so
+	// never block in accept after poll said it was readable
+	fcntl(sock_fd, F_SETFL, fcntl(sock_fd, F_GETFL) | O_NONBLOCK);
 
 	int new_fd;
 	struct sockaddr_storage their_addr; // client addr
 	socklen_t sin_size;
-	char s[ADDR_BUF_SIZE];
 
-	FILE *fp = fopen(WORK_FILE, "a+");
+	if (fp == NULL) {
+		fp = fopen(WORK_FILE, "a+");
+	}
 	if (fp == NULL) {
 		char *err_msg = strerror(errno);
 		fprintf(stderr, "Could not open work file: %s\n", err_msg);
 		exit(EXIT_FAILURE);
 	}
+	if (channels_init(&channels, fp, compress) != 0) {
+		fprintf(stderr, "Could not set up work log\n");
+		exit(EXIT_FAILURE);
+	}
 
 	// SIGINT or SIGTERM 
 	struct sigaction sa = {.sa_handler = sig_handler};
 	sigemptyset(&sa.sa_mask);
 	sigaction(SIGINT, &sa, NULL);
 	sigaction(SIGTERM, &sa, NULL);
+	struct sigaction sa_stats = {.sa_handler = stats_sig_handler};
+	sigemptyset(&sa_stats.sa_mask);
+	sigaction(SIGUSR1, &sa_stats, NULL);
 
 	// start timestamp thread
 	pthread_t ts_tid;
-	struct ts_worker_args tsa = {.fp = fp, .interval_sec = TIMESTAMP_INTERVAL};
+	struct ts_worker_args tsa = {.channels = &channels, .interval_sec = TIMESTAMP_INTERVAL};
 	pthread_create(&ts_tid, NULL, timestamp_worker, &tsa);
 	
 	// set up for client handler threads
-	SLIST_INIT(&chh);
+	int reg_err = thread_registry_init(&ch_threads, CH_THREAD_STACK_SIZE);
+	if (reg_err != 0) {
+		fprintf(stderr, "Could not start client thread registry: %s\n", strerror(reg_err));
+		exit(EXIT_FAILURE);
+	}
 
-	// TODO: start client handler thread reaper
-	pthread_t ch_reaper_tid;
-	pthread_create(&ch_reaper_tid, NULL, ch_thread_reaper, NULL);
+	// one pool per node group, so connection state stays on its node
+	int npools = node_groups ? placement.nnodes : 1;
+	struct conn_pool *conn_pools = calloc(npools, sizeof(*conn_pools));
+	pthread_attr_t *client_attrs = NULL;
+	if (conn_pools == NULL) {
+		fprintf(stderr, "Could not alloc mem for connection pools\n");
+		exit(EXIT_FAILURE);
+	}
+	for (int i = 0; i < npools; i++) {
+		conn_pool_init(&conn_pools[i]);
+	}
+
+	// client threads would otherwise inherit the accept thread's cpus
+	if (placement.pin_io || node_groups) {
+		client_attrs = calloc(npools, sizeof(*client_attrs));
+		if (client_attrs == NULL) {
+			fprintf(stderr, "Could not alloc mem for thread attributes\n");
+			exit(EXIT_FAILURE);
+		}
+		for (int i = 0; i < npools; i++) {
+			pthread_attr_init(&client_attrs[i]);
+			pthread_attr_setstacksize(&client_attrs[i], CH_THREAD_STACK_SIZE);
+			pthread_attr_setaffinity_np(&client_attrs[i], sizeof(cpu_set_t),
+						    node_groups ? &placement.node_cpus[i] : &placement.all_cpus);
+		}
+	}
+	if (placement.pin_io) {
+		placement_pin(pthread_self(), &placement.io_cpus);
+		placement_pin(ts_tid, &placement.io_cpus);
+		placement_pin(ch_threads.reaper, &placement.io_cpus);
+	}
+	if (node_groups) {
+		for (int i = 0; i < placement.nnodes; i++) {
+			syslog(LOG_USER|LOG_INFO, "Node %d serves connections arriving on %d cpus",
+			       placement.node_ids[i], CPU_COUNT(&placement.node_cpus[i]));
+		}
+	}
+
+	int handoff_fd = handoff_listen();
+	int successor_fd = -1;
 
 	// accept loop
+	struct pollfd pfds[4] = {
+		{.fd = sock_fd, .events = POLLIN},
+		{.fd = shutdown_fd, .events = POLLIN},
+		{.events = POLLIN},
+		{.fd = stats_fd, .events = POLLIN},
+	};
 	while(cease == false) {
+		// a successor's handoff name frees up once its predecessor exits
+		if (handoff_fd == -1) {
+			handoff_fd = handoff_listen();
+		}
+		pfds[2].fd = handoff_fd;
+		if (poll(pfds, 4, handoff_fd == -1 ? HANDOFF_RETRY_MS : -1) == -1) {
+			if (errno != EINTR) {
+				perror("poll");
+			}
+			continue;
+		}
+		if (pfds[1].revents) {
+			break;
+		}
+		// nothing changes until the successor holds the fds, so a
+		// refused or failed handoff just goes on serving
+		if (pfds[2].revents) {
+			int fds[] = {sock_fd, fileno(fp)};
+			successor_fd = handoff_give(handoff_fd, fds, 2);
+			if (successor_fd != -1) {
+				successor_waiting = true;
+				break;
+			}
+			continue;
+		}
+		if (pfds[3].revents) {
+			eventfd_t ignored;
+			eventfd_read(stats_fd, &ignored);
+			log_alloc_stats(conn_pools, npools);
+		}
+		if (!(pfds[0].revents & POLLIN)) {
+			continue;
+		}
+
 		sin_size = sizeof their_addr;
 		new_fd = accept(sock_fd, (struct sockaddr *)&their_addr, &sin_size);
 		if (new_fd == -1) {
-			perror("accept");
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+				perror("accept");
+			}
 			continue;
 		}
 
+		int node = placement_conn_node(&placement, new_fd);
+		struct conn *c = conn_pool_get(&conn_pools[node]);
+		if (c == NULL) {
+			close(new_fd);
+			continue;
+		}
+		c->node = node;
+		if (capture != NULL) {
+			c->trace_id = trace_conn_open(capture);
+		}
 		inet_ntop(their_addr.ss_family,
 			get_in_addr((struct sockaddr *)&their_addr),
-			s, sizeof s);
+			c->client_addr, sizeof c->client_addr);
 
-		syslog(LOG_USER||LOG_INFO, "Accepted connection from %s", s);
+		syslog(LOG_USER|LOG_INFO, "Accepted connection from %s", c->client_addr);
 
-		struct ch_worker_args *wargs = malloc(sizeof(struct ch_worker_args));
-		wargs->fp = fp;
-		strncpy(wargs->client_addr, s, ADDR_BUF_SIZE);
-		wargs->conn_fd = new_fd;
+		c->conn_fd = new_fd;
 	
-		pthread_t ch_tid;
-		pthread_create(&ch_tid, NULL, handle_conn, wargs);
+		int spawn_err = client_attrs == NULL ?
+			thread_registry_spawn(&ch_threads, handle_conn, c) :
+			thread_registry_spawn_attr(&ch_threads, &client_attrs[node], handle_conn, c);
+		if (spawn_err != 0) {
+			syslog(LOG_USER|LOG_ERR, "Could not start thread for %s: %s", c->client_addr, strerror(spawn_err));
+			close(new_fd);
+			if (capture != NULL) {
+				trace_conn_close(capture, c->trace_id);
+			}
+			conn_pool_put(c);
+			continue;
+		}
 
-		ch_reaper_new_thread(ch_tid);
+		syslog(LOG_USER|LOG_INFO, "Handling %s", c->client_addr);
 
-		syslog(LOG_USER||LOG_INFO, "Handling %s in thread %lu", s, ch_tid);		
-		
 	}
 
-	shutdown(sock_fd, 0);
-
-	// wait for utility threads to cease
+	// on a handoff, established clients get a while to finish on their
+	// own. new connections meanwhile queue on the listening socket for
+	// whoever accepts next.
+	if (successor_waiting && !thread_registry_wait_idle(&ch_threads, HANDOFF_DRAIN_MS)) {
+		syslog(LOG_USER|LOG_INFO, "Closing %zu clients still connected after %d ms",
+		       thread_registry_live(&ch_threads), HANDOFF_DRAIN_MS);
+	}
+	// wait for utility and client handler threads to cease
+	request_shutdown();
 	pthread_join(ts_tid, NULL);
-	pthread_join(ch_reaper_tid, NULL);
+	log_alloc_stats(conn_pools, npools);
+	thread_registry_destroy(&ch_threads);
+	for (int i = 0; i < npools; i++) {
+		conn_pool_destroy(&conn_pools[i]);
+		if (client_attrs != NULL) {
+			pthread_attr_destroy(&client_attrs[i]);
+		}
+	}
+	free(conn_pools);
+	free(client_attrs);
+	if (capture != NULL) {
+		trace_close(capture);
+	}
 
+	// with every writer stopped the logs can move to the successor whole;
+	// the default file and socket are shared with it, so only close our
+	// fds. other channels' files are reopened by name when next used.
+	if (successor_waiting) {
+		channels_sync(&channels);
+		handoff_release(successor_fd);
+		syslog(LOG_USER|LOG_INFO, "Handed off to new instance");
+	}
+	if (!successor_waiting) {
+		shutdown(sock_fd, 0);
+	}
 	close(sock_fd);
-	
-	fclose(fp);
-	unlink(WORK_FILE);
+	if (handoff_fd != -1) {
+		close(handoff_fd);
+	}
+
+	// the history lives on in the successor
+	channels_destroy(&channels, !successor_waiting);
+	close(shutdown_fd);
+	close(stats_fd);
 
 	return 0;
 }
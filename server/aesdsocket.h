@@ -6,14 +6,22 @@
 #define AESD_SOCK_FAIL -1
 #define WORK_FILE "/var/tmp/aesdsocketdata"
 #define NET_BUF_SIZE 1000
+#define SHUTDOWN_SEND_GRACE_MS 1000
+#define REPLY_BUF_SIZE (16 * 1024)
 
-extern bool cease; // flag for threads to quit
-extern pthread_mutex_t work_file_lock;
+// A client that opens with BIN_MAGIC switches the connection to binary
+// framing: each record is a 4-byte big-endian length and that many bytes
+// of payload, and the reply is the whole history framed the same way.
+// Opening with BIN_Z_MAGIC instead asks for the history as the work log's
+// segments (see worklog.h), compressed ones passed through as stored.
+#define BIN_MAGIC "AESDBIN1"
+#define BIN_Z_MAGIC "AESDBINZ"
+#define BIN_MAGIC_LEN (sizeof(BIN_MAGIC) - 1)
+#define BIN_HDR_LEN 4
+#define BIN_MAX_FRAME (64 * 1024 * 1024) // largest record a client may send
 
-// bring in from openbsd's sys/queue.h
-#define	SLIST_FOREACH_SAFE(var, head, field, tvar)			\
-	for ((var) = SLIST_FIRST(head);				\
-	    (var) && ((tvar) = SLIST_NEXT(var, field), 1);		\
-	    (var) = (tvar))
+extern bool cease; // flag for threads to quit
+extern int shutdown_fd; // eventfd, readable once cease is set
+extern int stats_fd; // eventfd, written on SIGUSR1
 
 #endif
\ No newline at end of file
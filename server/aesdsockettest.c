@@ -0,0 +1,142 @@
+/*
+Regression checks for a running aesdsocket, started without -c.
+
+Sends two newline terminated packets in a single write on a persistent text
+connection and checks that each is answered with the history as of that
+packet: the first reply ends at the first packet, the second at the second,
+and nothing else follows.  The history already in the work file is learned
+first from the reply to a marker packet, so the check works on a server
+that has been in use.
+
+usage: aesdsockettest [host [port]]
+*/
+
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "aesdsocket.h"
+#include "netclient.h"
+
+#define TEST_REPLY_TIMEOUT_MS 2000
+#define TEST_QUIET_MS 200
+
+// reads exactly len bytes into buf. returns false on error, eof or timeout.
+static bool read_exact(int fd, char *buf, size_t len) {
+	struct pollfd pfd = {.fd = fd, .events = POLLIN};
+	size_t got = 0;
+
+	while (got < len) {
+		if (poll(&pfd, 1, TEST_REPLY_TIMEOUT_MS) != 1) {
+			return false;
+		}
+		ssize_t n = read(fd, buf + got, len - got);
+		if (n <= 0) {
+			return false;
+		}
+		got += n;
+	}
+	return true;
+}
+
+// reads until the received bytes end with tail. returns a malloc'd buffer
+// and sets *len, or NULL on error, eof or timeout.
+static char *read_until(int fd, const char *tail, size_t *len) {
+	struct pollfd pfd = {.fd = fd, .events = POLLIN};
+	size_t tail_len = strlen(tail);
+	size_t cap = 4096;
+	char *buf = malloc(cap);
+
+	*len = 0;
+	while (buf != NULL && (*len < tail_len || memcmp(buf + *len - tail_len, tail, tail_len) != 0)) {
+		if (*len == cap) {
+			char *grown = realloc(buf, cap * 2);
+			if (grown == NULL) {
+				break;
+			}
+			buf = grown;
+			cap *= 2;
+		}
+		if (poll(&pfd, 1, TEST_REPLY_TIMEOUT_MS) != 1) {
+			break;
+		}
+		ssize_t n = read(fd, buf + *len, cap - *len);
+		if (n <= 0) {
+			break;
+		}
+		*len += n;
+	}
+	if (buf != NULL && (*len < tail_len || memcmp(buf + *len - tail_len, tail, tail_len) != 0)) {
+		free(buf);
+		buf = NULL;
+	}
+	return buf;
+}
+
+// a multi-line recv gets one reply per line, each ending at that line
+static bool test_multiline_recv(const char *host, const char *port) {
+	char marker[64], first[64], second[64], lines[128], extra;
+	size_t history_len, first_len, second_len;
+	char *history = NULL, *replies = NULL;
+	bool ok = false;
+	int fd;
+
+	snprintf(marker, sizeof(marker), "aesdsockettest %d %ld marker\n", (int)getpid(), (long)time(NULL));
+	snprintf(first, sizeof(first), "aesdsockettest %d first\n", (int)getpid());
+	snprintf(second, sizeof(second), "aesdsockettest %d second\n", (int)getpid());
+	snprintf(lines, sizeof(lines), "%s%s", first, second);
+	first_len = strlen(first);
+	second_len = strlen(second);
+
+	fd = client_connect(host, port);
+	if (fd == -1) {
+		fprintf(stderr, "FAIL: could not connect to %s:%s\n", host, port);
+		return false;
+	}
+	if (!client_send(fd, marker, strlen(marker)) ||
+	    (history = read_until(fd, marker, &history_len)) == NULL) {
+		fprintf(stderr, "FAIL: no reply to the marker packet\n");
+		goto out;
+	}
+
+	// both lines go out in one segment, so the server sees them in one recv
+	size_t want = 2 * (history_len + first_len) + second_len;
+	replies = malloc(want);
+	if (replies == NULL || !client_send(fd, lines, strlen(lines)) || !read_exact(fd, replies, want)) {
+		fprintf(stderr, "FAIL: expected %zu reply bytes for a two line packet\n", want);
+		goto out;
+	}
+	if (memcmp(replies, history, history_len) != 0 ||
+	    memcmp(replies + history_len, first, first_len) != 0 ||
+	    memcmp(replies + history_len + first_len, history, history_len) != 0 ||
+	    memcmp(replies + 2 * history_len + first_len, lines, first_len + second_len) != 0) {
+		fprintf(stderr, "FAIL: replies to a two line packet do not end at each line\n");
+		goto out;
+	}
+	struct pollfd pfd = {.fd = fd, .events = POLLIN};
+	if (poll(&pfd, 1, TEST_QUIET_MS) == 1 && read(fd, &extra, 1) == 1) {
+		fprintf(stderr, "FAIL: more replies than packets for a two line packet\n");
+		goto out;
+	}
+	ok = true;
+out:
+	free(history);
+	free(replies);
+	close(fd);
+	return ok;
+}
+
+int main(int argc, char **argv) {
+	const char *host = argc > 1 ? argv[1] : "localhost";
+	const char *port = argc > 2 ? argv[2] : PORT_NUM;
+
+	if (!test_multiline_recv(host, port)) {
+		return 1;
+	}
+	printf("PASS: multi-line recv answered once per line\n");
+	return 0;
+}
@@ -0,0 +1,123 @@
+#define _GNU_SOURCE // asprintf
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "aesdsocket.h"
+#include "channels.h"
+
+// the table only grows and its slots are written before count, so a
+// reader that saw count under the lock may use that many slots without it
+static size_t open_count(struct channel_table *t) {
+	pthread_mutex_lock(&t->lock);
+	size_t count = t->count;
+	pthread_mutex_unlock(&t->lock);
+	return count;
+}
+
+static struct channel *new_channel(const char *name, FILE *fp, bool compress) {
+	struct channel *ch = calloc(1, sizeof(*ch));
+	if (ch == NULL) {
+		return NULL;
+	}
+	strcpy(ch->name, name);
+	if (asprintf(&ch->path, "%s%s%s", WORK_FILE, *name ? "." : "", name) == -1) {
+		free(ch);
+		return NULL;
+	}
+	if (fp == NULL) {
+		fp = fopen(ch->path, "a+");
+	}
+	if (fp == NULL || work_log_init(&ch->log, fp, compress) != 0) {
+		syslog(LOG_USER|LOG_ERR, "Could not open channel file %s: %s", ch->path, strerror(errno));
+		if (fp != NULL) {
+			ch->log.fp = fp;
+			work_log_destroy(&ch->log);
+		}
+		free(ch->path);
+		free(ch);
+		return NULL;
+	}
+	return ch;
+}
+
+int channels_init(struct channel_table *t, FILE *fp, bool compress) {
+	memset(t, 0, sizeof(*t));
+	pthread_mutex_init(&t->lock, NULL);
+	t->compress = compress;
+	t->chans[0] = new_channel("", fp, compress);
+	if (t->chans[0] == NULL) {
+		return -1;
+	}
+	t->count = 1;
+	return 0;
+}
+
+bool channel_name_valid(const char *name) {
+	size_t len = strlen(name);
+
+	if (len == 0 || len > CHANNEL_NAME_MAX) {
+		return false;
+	}
+	return strspn(name, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_") == len;
+}
+
+struct work_log *channels_get(struct channel_table *t, const char *name) {
+	struct work_log *log = NULL;
+
+	if (*name == '\0') {
+		return &t->chans[0]->log;
+	}
+	pthread_mutex_lock(&t->lock);
+	for (size_t i = 1; i < t->count; i++) {
+		if (strcmp(t->chans[i]->name, name) == 0) {
+			log = &t->chans[i]->log;
+			break;
+		}
+	}
+	if (log == NULL) {
+		if (t->count == CHANNEL_MAX) {
+			syslog(LOG_USER|LOG_ERR, "No room for channel %s, %d are open", name, CHANNEL_MAX);
+		} else if ((t->chans[t->count] = new_channel(name, NULL, t->compress)) != NULL) {
+			log = &t->chans[t->count++]->log;
+			syslog(LOG_USER|LOG_INFO, "Opened channel %s", name);
+		}
+	}
+	pthread_mutex_unlock(&t->lock);
+	return log;
+}
+
+void channels_append_all(struct channel_table *t, const struct iovec *iov, size_t count) {
+	size_t n = open_count(t);
+
+	for (size_t i = 0; i < n; i++) {
+		work_log_append(&t->chans[i]->log, iov, count);
+	}
+}
+
+void channels_sync(struct channel_table *t) {
+	size_t n = open_count(t);
+
+	for (size_t i = 0; i < n; i++) {
+		work_log_sync(&t->chans[i]->log);
+	}
+}
+
+void channels_destroy(struct channel_table *t, bool remove_files) {
+	for (size_t i = 0; i < t->count; i++) {
+		struct channel *ch = t->chans[i];
+		work_log_destroy(&ch->log);
+		if (remove_files) {
+			unlink(ch->path);
+		}
+		free(ch->path);
+		free(ch);
+	}
+	t->count = 0;
+	pthread_mutex_destroy(&t->lock);
+}
@@ -0,0 +1,56 @@
+#ifndef channels_h_
+#define channels_h_
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/uio.h>
+
+#include "worklog.h"
+
+// Independent histories served by one instance.  A client that opens with
+// a CHANNEL_PREFIX line, "AESDCHAN name\n", before anything else, binary
+// magic included, appends to and hears back only that channel.  Every
+// channel has its own work file, WORK_FILE "." name, and its own work_log,
+// so channels never wait on each other's lock.  Clients that name no
+// channel use the default one, kept in WORK_FILE itself.  Channels are
+// opened on first use and live as long as the server.
+
+#define CHANNEL_PREFIX "AESDCHAN "
+#define CHANNEL_PREFIX_LEN (sizeof(CHANNEL_PREFIX) - 1)
+#define CHANNEL_NAME_MAX 32
+#define CHANNEL_MAX 64
+
+struct channel {
+	char name[CHANNEL_NAME_MAX + 1];	// empty for the default channel
+	char *path;
+	struct work_log log;
+};
+
+struct channel_table {
+	pthread_mutex_t lock;		// guards opening channels
+	struct channel *chans[CHANNEL_MAX];
+	size_t count;
+	bool compress;
+};
+
+// sets up the table with the default channel on fp, taking fp over.
+// returns 0 or -1.
+int channels_init(struct channel_table *, FILE *fp, bool compress);
+
+// names are 1 to CHANNEL_NAME_MAX letters, digits, '-' or '_'
+bool channel_name_valid(const char *);
+
+// the log of the named channel, opened if need be; an empty name is the
+// default channel. returns NULL if the channel cannot be opened.
+struct work_log *channels_get(struct channel_table *, const char *name);
+
+// appends to every open channel, as timestamps are
+void channels_append_all(struct channel_table *, const struct iovec *, size_t);
+
+// seals every channel's log, see work_log_sync
+void channels_sync(struct channel_table *);
+
+// closes every channel, deleting its work file if asked
+void channels_destroy(struct channel_table *, bool remove_files);
+
+#endif
@@ -0,0 +1,151 @@
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+#include "aesdsocket.h"
+#include "connpool.h"
+
+void conn_pool_init(struct conn_pool *pool) {
+	memset(pool, 0, sizeof(*pool));
+	atomic_init(&pool->returned, NULL);
+	pool->buf_target = 1024 + NET_BUF_SIZE;
+}
+
+// the buffer should hold a typical packet plus one more recv behind it.
+// the 90th percentile of the size classes seen sets "typical"; the counts
+// are then halved so the target follows changes in the traffic.
+static void retune(struct conn_pool *pool) {
+	unsigned long total = 0, seen = 0;
+	int c;
+
+	for (c = 0; c < CONN_POOL_SIZE_CLASSES; c++) {
+		total += pool->sizes[c];
+	}
+	if (total == 0) {
+		return;
+	}
+	for (c = 0; c < CONN_POOL_SIZE_CLASSES - 1; c++) {
+		seen += pool->sizes[c];
+		if (seen * 10 >= total * 9) {
+			break;
+		}
+	}
+	size_t target = ((size_t)1 << c) + NET_BUF_SIZE;
+	pool->buf_target = target < CONN_BUF_MAX_TARGET ? target : CONN_BUF_MAX_TARGET;
+	for (c = 0; c < CONN_POOL_SIZE_CLASSES; c++) {
+		pool->sizes[c] /= 2;
+	}
+}
+
+// takes back everything client threads returned since the last call
+static void drain_returned(struct conn_pool *pool) {
+	struct conn *c = atomic_exchange_explicit(&pool->returned, NULL, memory_order_acquire);
+
+	while (c != NULL) {
+		struct conn *next = c->next;
+		for (int i = 0; i < CONN_POOL_SIZE_CLASSES; i++) {
+			pool->sizes[i] += c->sizes[i];
+		}
+		pool->stats.buf_grown += c->buf_grown;
+		pool->stats.buf_trimmed += c->buf_trimmed;
+		if (pool->nidle < CONN_POOL_MAX_IDLE) {
+			c->next = pool->idle;
+			pool->idle = c;
+			pool->nidle++;
+		} else {
+			free(c->in.data);
+			free(c->pb.iov);
+			work_log_reader_free(&c->reader);
+			free(c);
+		}
+		c = next;
+	}
+}
+
+struct conn *conn_pool_get(struct conn_pool *pool) {
+	struct conn *c;
+
+	if (pool->idle == NULL) {
+		drain_returned(pool);
+	}
+	if (++pool->stats.acquired % CONN_POOL_RETUNE_EVERY == 0) {
+		retune(pool);
+	}
+
+	c = pool->idle;
+	if (c != NULL) {
+		pool->idle = c->next;
+		pool->nidle--;
+		pool->stats.reused++;
+	} else {
+		c = calloc(1, sizeof(*c));
+		if (c == NULL) {
+			syslog(LOG_USER|LOG_ERR, "Could not alloc mem for connection: %s", strerror(errno));
+			return NULL;
+		}
+		c->pool = pool;
+		pool->stats.allocated++;
+	}
+	memset(c->sizes, 0, sizeof(c->sizes));
+	c->buf_target = pool->buf_target;
+	c->buf_grown = 0;
+	c->buf_trimmed = 0;
+	c->in.len = 0;
+	c->pb.count = 0;
+	return c;
+}
+
+// a buffer a little small is fine, it grows on demand; one left far too
+// big by an outsized packet is given back
+void conn_fit_buffer(struct conn *c) {
+	if (c->in.cap >= c->buf_target && c->in.cap <= 2 * c->buf_target) {
+		return;
+	}
+	char *data = realloc(c->in.data, c->buf_target);
+	if (data == NULL) {
+		return;
+	}
+	if (c->in.cap < c->buf_target) {
+		c->buf_grown++;
+	} else {
+		c->buf_trimmed++;
+	}
+	c->in.data = data;
+	c->in.cap = c->buf_target;
+}
+
+void conn_pool_put(struct conn *c) {
+	struct conn_pool *pool = c->pool;
+
+	c->next = atomic_load_explicit(&pool->returned, memory_order_relaxed);
+	while (!atomic_compare_exchange_weak_explicit(&pool->returned, &c->next, c,
+						      memory_order_release, memory_order_relaxed)) {
+	}
+}
+
+void conn_note_packet(struct conn *c, size_t len) {
+	int cls = 0;
+
+	while (len > 0 && cls < CONN_POOL_SIZE_CLASSES - 1) {
+		len >>= 1;
+		cls++;
+	}
+	c->sizes[cls]++;
+}
+
+void conn_pool_destroy(struct conn_pool *pool) {
+	struct conn *c;
+
+	drain_returned(pool);
+	while ((c = pool->idle) != NULL) {
+		pool->idle = c->next;
+		free(c->in.data);
+		free(c->pb.iov);
+		work_log_reader_free(&c->reader);
+		free(c);
+	}
+	pool->nidle = 0;
+}
@@ -0,0 +1,99 @@
+#ifndef connpool_h_
+#define connpool_h_
+#include <arpa/inet.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "worklog.h"
+
+// Connection state is recycled rather than freed, so once the pool has
+// warmed up accepting and serving a connection allocates nothing.  Only
+// the accepting thread takes connections from the pool; client threads
+// hand theirs back on a lock-free return stack, which the accepting
+// thread empties whenever its own free list runs dry.  Receive buffers
+// are kept with their connection and resized on reuse towards a target
+// derived from the packet sizes seen recently.  The resizing is left to
+// the client thread, so a thread pinned to a NUMA node touches its buffer
+// there first; with one pool per node the buffer then stays on that node.
+
+#define ADDR_BUF_SIZE (INET6_ADDRSTRLEN + 1)
+#define CONN_POOL_MAX_IDLE 256		// connections kept beyond this are freed
+#define CONN_POOL_RETUNE_EVERY 256	// acquisitions between buffer target updates
+#define CONN_POOL_SIZE_CLASSES 32	// log2 classes of the packet size histogram
+#define CONN_BUF_MAX_TARGET (64 * 1024)
+
+// bytes received from a client and not yet consumed
+struct conn_buf {
+	char *data;
+	size_t len;
+	size_t cap;
+};
+
+// packets completed by one recv batch, committed and answered together
+struct packet_batch {
+	struct iovec *iov;
+	size_t count;
+	size_t cap;
+};
+
+struct conn_pool;
+
+struct conn {
+	struct conn *next;		// free list and return stack link
+	struct conn_pool *pool;
+	struct work_log *log;
+	int conn_fd;
+	int node;			// placement node group serving it
+	uint64_t trace_id;		// connection id in the capture, if any
+	uint64_t recv_us;		// when the latest recv returned, if capturing
+	char client_addr[ADDR_BUF_SIZE];
+	struct conn_buf in;
+	struct packet_batch pb;
+	struct work_log_reader reader;
+	// tallied by the client thread, folded into the pool on return
+	unsigned long sizes[CONN_POOL_SIZE_CLASSES];
+	size_t buf_target;
+	unsigned long buf_grown;
+	unsigned long buf_trimmed;
+};
+
+struct conn_pool_stats {
+	unsigned long acquired;
+	unsigned long allocated;	// connections malloc'd
+	unsigned long reused;		// connections served from the pool
+	unsigned long buf_grown;	// recv buffers allocated or grown
+	unsigned long buf_trimmed;	// oversized recv buffers shrunk on reuse
+};
+
+struct conn_pool {
+	// everything but returned belongs to the accepting thread
+	struct conn *idle;
+	size_t nidle;
+	_Atomic(struct conn *) returned;
+	unsigned long sizes[CONN_POOL_SIZE_CLASSES];
+	size_t buf_target;
+	struct conn_pool_stats stats;
+};
+
+void conn_pool_init(struct conn_pool *);
+
+// returns a connection with an empty buffer and batch, or NULL if out of memory
+struct conn *conn_pool_get(struct conn_pool *);
+
+// brings the recv buffer to the pool's target size; called by the thread
+// that serves the connection
+void conn_fit_buffer(struct conn *);
+
+// hands a connection back from any thread; its fd must already be closed
+void conn_pool_put(struct conn *);
+
+// counts a packet of len bytes towards the buffer sizing
+void conn_note_packet(struct conn *, size_t len);
+
+// frees every pooled connection; every connection must have been put back
+void conn_pool_destroy(struct conn_pool *);
+
+#endif
@@ -0,0 +1,171 @@
+#define _GNU_SOURCE // struct ucred
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "aesdsocket.h"
+#include "handoff.h"
+
+// abstract names start with a NUL and vanish with the last fd, so a crashed
+// instance never leaves a stale socket file behind
+static socklen_t handoff_addr(struct sockaddr_un *addr) {
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	memcpy(addr->sun_path + 1, HANDOFF_SOCK_NAME, sizeof(HANDOFF_SOCK_NAME) - 1);
+	return offsetof(struct sockaddr_un, sun_path) + sizeof(HANDOFF_SOCK_NAME);
+}
+
+int handoff_listen(void) {
+	struct sockaddr_un addr;
+	socklen_t len = handoff_addr(&addr);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (fd == -1) {
+		return -1;
+	}
+	if (bind(fd, (struct sockaddr *)&addr, len) == -1 || listen(fd, 1) == -1) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// waits up to HANDOFF_TIMEOUT_MS for fd to become readable
+static bool handoff_wait(int fd) {
+	struct pollfd pfd = {.fd = fd, .events = POLLIN};
+	int n;
+
+	do {
+		n = poll(&pfd, 1, HANDOFF_TIMEOUT_MS);
+	} while (n == -1 && errno == EINTR);
+	return n == 1;
+}
+
+int handoff_give(int handoff_fd, const int *fds, size_t nfds) {
+	char cbuf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+	char tag = 'H', ack;
+	struct iovec iov = {.iov_base = &tag, .iov_len = 1};
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = cbuf,
+		.msg_controllen = CMSG_SPACE(sizeof(int) * nfds),
+	};
+	struct ucred cred;
+	socklen_t cred_len = sizeof(cred);
+
+	if (nfds > HANDOFF_MAX_FDS) {
+		return -1;
+	}
+	int conn_fd = accept4(handoff_fd, NULL, NULL, SOCK_CLOEXEC);
+	if (conn_fd == -1) {
+		return -1;
+	}
+
+	// the name is visible to every user in the network namespace
+	if (getsockopt(conn_fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == -1 ||
+	    cred.uid != geteuid()) {
+		syslog(LOG_USER|LOG_ERR, "Refusing handoff to uid %d", (int)cred.uid);
+		close(conn_fd);
+		return -1;
+	}
+
+	memset(cbuf, 0, sizeof(cbuf));
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfds);
+
+	if (sendmsg(conn_fd, &msg, MSG_NOSIGNAL) != 1 || !handoff_wait(conn_fd) ||
+	    read(conn_fd, &ack, 1) != 1 || ack != 'A') {
+		syslog(LOG_USER|LOG_ERR, "Handoff to new instance failed, still serving");
+		close(conn_fd);
+		return -1;
+	}
+	return conn_fd;
+}
+
+void handoff_release(int conn_fd) {
+	char go = 'G';
+
+	if (send(conn_fd, &go, 1, MSG_NOSIGNAL) != 1) {
+		syslog(LOG_USER|LOG_ERR, "Could not release new instance: %s", strerror(errno));
+	}
+	close(conn_fd);
+}
+
+int handoff_take(int *fds, size_t nfds) {
+	char cbuf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+	char tag;
+	struct iovec iov = {.iov_base = &tag, .iov_len = 1};
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = cbuf,
+		.msg_controllen = sizeof(cbuf),
+	};
+	struct sockaddr_un addr;
+	socklen_t len = handoff_addr(&addr);
+
+	if (nfds > HANDOFF_MAX_FDS) {
+		return -1;
+	}
+	int conn_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (conn_fd == -1) {
+		return -1;
+	}
+	if (connect(conn_fd, (struct sockaddr *)&addr, len) == -1) {
+		close(conn_fd);
+		return -1;
+	}
+	if (!handoff_wait(conn_fd) || recvmsg(conn_fd, &msg, MSG_CMSG_CLOEXEC) != 1) {
+		close(conn_fd);
+		return -1;
+	}
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+	    cmsg->cmsg_len != CMSG_LEN(sizeof(int) * nfds)) {
+		syslog(LOG_USER|LOG_ERR, "Unexpected handoff message");
+		if (cmsg != NULL && cmsg->cmsg_type == SCM_RIGHTS) {
+			int *got = (int *)CMSG_DATA(cmsg);
+			for (size_t i = 0; i < (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int); i++) {
+				close(got[i]);
+			}
+		}
+		close(conn_fd);
+		return -1;
+	}
+	memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * nfds);
+
+	char ack = 'A';
+	if (write(conn_fd, &ack, 1) != 1) {
+		syslog(LOG_USER|LOG_ERR, "Could not acknowledge handoff: %s", strerror(errno));
+		for (size_t i = 0; i < nfds; i++) {
+			close(fds[i]);
+		}
+		close(conn_fd);
+		return -1;
+	}
+	return conn_fd;
+}
+
+// no timeout: the predecessor stops within its send grace once its
+// clients are told to go, and if it dies instead the read sees EOF
+void handoff_wait_release(int conn_fd) {
+	char go;
+
+	while (read(conn_fd, &go, 1) == -1 && errno == EINTR) {
+	}
+	close(conn_fd);
+}
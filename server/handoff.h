@@ -0,0 +1,42 @@
+#ifndef handoff_h_
+#define handoff_h_
+#include <stdbool.h>
+#include <stddef.h>
+
+// Hot restart.  A running aesdsocket listens on an abstract unix socket; a
+// new instance started with -r connects to it and is passed the listening
+// socket and the work file over SCM_RIGHTS.  The new instance acknowledges
+// the fds, and only then does the old one stop accepting.  The old one
+// finishes its clients and seals its logs, then releases the new one,
+// which starts serving.  Connections arriving in between wait in the
+// listen backlog, so the port never refuses one and the history is never
+// reloaded.  Until the acknowledgement nothing has changed, so a failed
+// or refused handoff leaves the old instance serving as before.
+
+#define HANDOFF_SOCK_NAME "aesdsocket-handoff-" PORT_NUM
+#define HANDOFF_MAX_FDS 4
+#define HANDOFF_TIMEOUT_MS 5000
+
+// returns a listening socket for successors, or -1 if another instance holds the name
+int handoff_listen(void);
+
+// accepts a successor on the handoff socket and passes it nfds fds.
+// returns a connection to the successor once it has acknowledged them;
+// the caller should then stop, and hand the connection to handoff_release
+// when it no longer touches the shared files. on -1 the caller keeps
+// serving.
+int handoff_give(int handoff_fd, const int *fds, size_t nfds);
+
+// lets the successor start and closes conn_fd
+void handoff_release(int conn_fd);
+
+// fetches nfds fds from the running instance and acknowledges them.
+// returns a connection to wait on with handoff_wait_release, or -1 if
+// there was nothing to take over.
+int handoff_take(int *fds, size_t nfds);
+
+// waits until the predecessor has released the shared files, or has gone,
+// and closes conn_fd
+void handoff_wait_release(int conn_fd);
+
+#endif
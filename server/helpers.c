@@ -10,6 +10,10 @@
 #include <string.h>
 #include <syslog.h>
 #include <sys/wait.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <stdint.h>
 
 #include "aesdsocket.h"
 
@@ -24,6 +28,19 @@ void *get_in_addr(struct sockaddr *sa)
 	return &(((struct sockaddr_in6*)sa)->sin6_addr);
 }
 
+// binary frame lengths are 32-bit big-endian
+uint32_t get_frame_len(const unsigned char *hdr) {
+	return (uint32_t)hdr[0] << 24 | (uint32_t)hdr[1] << 16 |
+	       (uint32_t)hdr[2] << 8 | hdr[3];
+}
+
+void put_frame_len(unsigned char *hdr, uint32_t len) {
+	hdr[0] = len >> 24;
+	hdr[1] = len >> 16;
+	hdr[2] = len >> 8;
+	hdr[3] = len;
+}
+
 // returns socket file descriptor on success or exits program on failure.
 int must_bind_port_fd(int backlog, char *port_num) {
 	// set up socket listener
@@ -82,43 +99,56 @@ bool newline_in_buf(int bufsize, char *buf) {
 	return false;
 }
 
-void return_work_file_to_client(FILE *fp, int conn_fd) {
-	char buffer[NET_BUF_SIZE];
-
-	pthread_mutex_lock(&work_file_lock);
-	fseek(fp, 0, SEEK_SET);
-	while (fgets(buffer, sizeof(buffer), fp) != NULL) {
-		int wr_err = write(conn_fd, buffer, strlen(buffer));
-		if (wr_err < 0) {
-			syslog(LOG_USER||LOG_ERR, "couldn't write to client: %s", gai_strerror(wr_err));
+// sends all of buf, retrying short writes. returns false on error.
+// once shutting down, a client that stops reading gets SHUTDOWN_SEND_GRACE_MS
+// to drain before the reply is abandoned.
+bool send_all(int conn_fd, const void *buf, size_t len, int flags) {
+	struct pollfd pfds[2] = {
+		{.fd = conn_fd, .events = POLLOUT},
+		{.fd = shutdown_fd, .events = POLLIN},
+	};
+	const char *p = buf;
+	while (len > 0) {
+		ssize_t n = send(conn_fd, p, len, flags | MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				int ready = poll(pfds, cease ? 1 : 2, cease ? SHUTDOWN_SEND_GRACE_MS : -1);
+				if (ready == 0) {
+					syslog(LOG_USER|LOG_ERR, "client stopped reading, dropping reply");
+					return false;
+				}
+				continue;
+			}
+			syslog(LOG_USER|LOG_ERR, "couldn't write to client: %s", strerror(errno));
+			return false;
 		}
+		p += n;
+		len -= n;
 	}
-	pthread_mutex_unlock(&work_file_lock);
+	return true;
 }
 
-void write_buf_to_work_file(FILE *fp, char *out_buf) {
-	pthread_mutex_lock(&work_file_lock);
-	fseek(fp, 0, SEEK_END);
-	fputs(out_buf, fp);
-	pthread_mutex_unlock(&work_file_lock);
+// sets cease and wakes every thread polling shutdown_fd
+void request_shutdown(void) {
+	cease = true;
+	eventfd_write(shutdown_fd, 1);
 }
 
 void sig_handler(int s) {
-	syslog(LOG_USER||LOG_INFO, "Caught signal, exiting");
-	cease = true;
+	syslog(LOG_USER|LOG_INFO, "Caught signal, exiting");
+	request_shutdown();
 
 	int saved_errno = errno;
 	while(waitpid(-1, NULL, WNOHANG) > 0);
 	errno = saved_errno;
 }
 
-bool want_daemon(int argc, char **argv) {
-	for (int i = 0; i < argc; i++) {
-		if (strcmp(argv[i], "-d") == 0) {
-			printf("want daemon\n");
-			return true;
-		}
-	}
-
-	return false;
+// wakes the accept loop to log allocation stats
+void stats_sig_handler(int s) {
+	int saved_errno = errno;
+	eventfd_write(stats_fd, 1);
+	errno = saved_errno;
 }
@@ -1,13 +1,17 @@
 #ifndef helpers_h_
 #define helpers_h_
 #include <stdio.h>
+#include <stdint.h>
+#include <sys/uio.h>
 
 void *get_in_addr(struct sockaddr *);
 int must_bind_port_fd(int, char *);
 bool newline_in_buf(int, char *);
-void return_work_file_to_client(FILE *, int);
-void write_buf_to_work_file(FILE *, char *);
+uint32_t get_frame_len(const unsigned char *);
+void put_frame_len(unsigned char *, uint32_t);
+bool send_all(int, const void *, size_t, int);
+void request_shutdown(void);
 void sig_handler(int);
-bool want_daemon(int, char **);
+void stats_sig_handler(int);
 
 #endif
@@ -0,0 +1,86 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "latency.h"
+
+uint64_t latency_now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static bool reserve(struct latency_log *log, size_t more) {
+	if (log->cap - log->count >= more) {
+		return true;
+	}
+	size_t cap = log->cap ? log->cap : 1024;
+	while (cap - log->count < more) {
+		cap *= 2;
+	}
+	uint64_t *ns = realloc(log->ns, cap * sizeof(*ns));
+	if (ns == NULL) {
+		return false;
+	}
+	log->ns = ns;
+	log->cap = cap;
+	return true;
+}
+
+bool latency_add(struct latency_log *log, uint64_t ns) {
+	if (!reserve(log, 1)) {
+		return false;
+	}
+	log->ns[log->count++] = ns;
+	return true;
+}
+
+bool latency_merge(struct latency_log *dst, struct latency_log *src) {
+	if (!reserve(dst, src->count)) {
+		return false;
+	}
+	memcpy(dst->ns + dst->count, src->ns, src->count * sizeof(*src->ns));
+	dst->count += src->count;
+	src->count = 0;
+	return true;
+}
+
+static int cmp_ns(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+// nearest-rank percentile of sorted samples
+static double percentile_us(const struct latency_log *log, double p) {
+	size_t rank = (size_t)(p / 100 * log->count + 0.999999);
+	if (rank == 0) {
+		rank = 1;
+	}
+	return log->ns[rank - 1] / 1000.0;
+}
+
+void latency_report(struct latency_log *log, const char *what, FILE *out) {
+	uint64_t sum = 0;
+
+	if (log->count == 0) {
+		fprintf(out, "%s: no samples\n", what);
+		return;
+	}
+	qsort(log->ns, log->count, sizeof(*log->ns), cmp_ns);
+	for (size_t i = 0; i < log->count; i++) {
+		sum += log->ns[i];
+	}
+	fprintf(out, "%s over %zu samples (us): mean %.1f p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f\n",
+		what, log->count, (double)sum / log->count / 1000.0,
+		percentile_us(log, 50), percentile_us(log, 90), percentile_us(log, 99),
+		percentile_us(log, 99.9), log->ns[log->count - 1] / 1000.0);
+}
+
+void latency_free(struct latency_log *log) {
+	free(log->ns);
+	memset(log, 0, sizeof(*log));
+}
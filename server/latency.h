@@ -0,0 +1,28 @@
+#ifndef latency_h_
+#define latency_h_
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Latency samples kept whole, so percentiles are exact rather than binned.
+
+struct latency_log {
+	uint64_t *ns;
+	size_t count;
+	size_t cap;
+};
+
+uint64_t latency_now_ns(void);
+
+bool latency_add(struct latency_log *, uint64_t ns);
+
+// moves src's samples onto dst, emptying src
+bool latency_merge(struct latency_log *dst, struct latency_log *src);
+
+// sorts the samples and prints count, mean and percentiles
+void latency_report(struct latency_log *, const char *what, FILE *);
+
+void latency_free(struct latency_log *);
+
+#endif
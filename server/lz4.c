@@ -0,0 +1,160 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "lz4.h"
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5	// a block always ends in at least this many literals
+#define LZ4_MF_LIMIT 12		// and its last match starts at least this far from the end
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_HASH_LOG 12
+
+static uint32_t read32(const uint8_t *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint32_t lz4_hash(uint32_t seq) {
+	return (seq * 2654435761u) >> (32 - LZ4_HASH_LOG);
+}
+
+// writes the 15+255+255+... continuation of a length that overflowed its nibble
+static uint8_t *put_length(uint8_t *op, size_t len) {
+	for (; len >= 255; len -= 255) {
+		*op++ = 255;
+	}
+	*op++ = len;
+	return op;
+}
+
+// emits literals [lit, lit + lit_len) followed, unless mlen is 0, by a match.
+// returns NULL if the sequence would overrun end.
+static uint8_t *put_sequence(uint8_t *op, uint8_t *end, const uint8_t *lit, size_t lit_len,
+			     size_t offset, size_t mlen) {
+	size_t need = 1 + lit_len + lit_len / 255 + 1 + (mlen ? 2 + mlen / 255 + 1 : 0);
+	if ((size_t)(end - op) < need) {
+		return NULL;
+	}
+
+	uint8_t *token = op++;
+	*token = (lit_len >= 15 ? 15 : lit_len) << 4;
+	if (lit_len >= 15) {
+		op = put_length(op, lit_len - 15);
+	}
+	memcpy(op, lit, lit_len);
+	op += lit_len;
+	if (mlen == 0) {
+		return op;
+	}
+
+	*op++ = offset;
+	*op++ = offset >> 8;
+	mlen -= LZ4_MIN_MATCH;
+	*token |= mlen >= 15 ? 15 : mlen;
+	if (mlen >= 15) {
+		op = put_length(op, mlen - 15);
+	}
+	return op;
+}
+
+// greedy single-probe matcher: fast and good enough on log text
+size_t lz4_compress_block(const uint8_t *src, size_t n, uint8_t *dst, size_t dst_cap) {
+	uint32_t table[1 << LZ4_HASH_LOG];
+	uint8_t *op = dst, *end = dst + dst_cap;
+	size_t ip = 0, anchor = 0;
+
+	memset(table, 0, sizeof(table));
+	if (n > LZ4_MF_LIMIT) {
+		size_t limit = n - LZ4_MF_LIMIT;
+		while (ip < limit) {
+			uint32_t seq = read32(src + ip);
+			uint32_t h = lz4_hash(seq);
+			size_t ref = table[h];
+			table[h] = ip;
+
+			if (ref >= ip || ip - ref > LZ4_MAX_OFFSET || read32(src + ref) != seq) {
+				ip++;
+				continue;
+			}
+
+			size_t mlen = LZ4_MIN_MATCH;
+			size_t max_mlen = n - LZ4_LAST_LITERALS - ip;
+			while (mlen < max_mlen && src[ref + mlen] == src[ip + mlen]) {
+				mlen++;
+			}
+			while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+				ip--;
+				ref--;
+				mlen++;
+			}
+
+			op = put_sequence(op, end, src + anchor, ip - anchor, ip - ref, mlen);
+			if (op == NULL) {
+				return 0;
+			}
+			ip += mlen;
+			anchor = ip;
+		}
+	}
+
+	op = put_sequence(op, end, src + anchor, n - anchor, 0, 0);
+	return op == NULL ? 0 : (size_t)(op - dst);
+}
+
+size_t lz4_decompress_block(const uint8_t *src, size_t n, uint8_t *dst, size_t dst_cap) {
+	size_t ip = 0, op = 0;
+
+	while (ip < n) {
+		uint8_t token = src[ip++];
+		size_t lit_len = token >> 4;
+		if (lit_len == 15) {
+			uint8_t b;
+			do {
+				if (ip >= n) {
+					return SIZE_MAX;
+				}
+				b = src[ip++];
+				lit_len += b;
+			} while (b == 255);
+		}
+		if (lit_len > n - ip || lit_len > dst_cap - op) {
+			return SIZE_MAX;
+		}
+		memcpy(dst + op, src + ip, lit_len);
+		ip += lit_len;
+		op += lit_len;
+		if (ip == n) {
+			break;	// the last sequence has no match
+		}
+
+		if (n - ip < 2) {
+			return SIZE_MAX;
+		}
+		size_t offset = src[ip] | (size_t)src[ip + 1] << 8;
+		ip += 2;
+		if (offset == 0 || offset > op) {
+			return SIZE_MAX;
+		}
+		size_t mlen = token & 15;
+		if (mlen == 15) {
+			uint8_t b;
+			do {
+				if (ip >= n) {
+					return SIZE_MAX;
+				}
+				b = src[ip++];
+				mlen += b;
+			} while (b == 255);
+		}
+		mlen += LZ4_MIN_MATCH;
+		if (mlen > dst_cap - op) {
+			return SIZE_MAX;
+		}
+		// byte by byte, since the match may overlap what it produces
+		for (size_t i = 0; i < mlen; i++, op++) {
+			dst[op] = dst[op - offset];
+		}
+	}
+	return op;
+}
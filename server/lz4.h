@@ -0,0 +1,20 @@
+#ifndef lz4_h_
+#define lz4_h_
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimal codec for the LZ4 block format (no frame format, no dictionary),
+// so compressed history needs no library on the target.  Output from
+// lz4_compress_block decodes with any LZ4 block decoder and vice versa.
+
+// worst case compressed size for n input bytes
+#define LZ4_COMPRESS_BOUND(n) ((n) + (n) / 255 + 16)
+
+// returns the compressed size, or 0 if it would not fit in dst_cap
+size_t lz4_compress_block(const uint8_t *src, size_t n, uint8_t *dst, size_t dst_cap);
+
+// returns the decompressed size, or SIZE_MAX on malformed input or if the
+// output would not fit in dst_cap
+size_t lz4_decompress_block(const uint8_t *src, size_t n, uint8_t *dst, size_t dst_cap);
+
+#endif
@@ -0,0 +1,104 @@
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "aesdsocket.h"
+#include "netclient.h"
+
+int client_connect(const char *host, const char *port) {
+	struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+	struct addrinfo *res, *ai;
+	int fd = -1;
+
+	if (getaddrinfo(host, port, &hints, &res) != 0) {
+		return -1;
+	}
+	for (ai = res; ai != NULL; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd == -1) {
+			continue;
+		}
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+			break;
+		}
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+	if (fd != -1) {
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	}
+	return fd;
+}
+
+bool client_send(int fd, const void *buf, size_t len) {
+	const char *p = buf;
+
+	while (len > 0) {
+		ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+static bool recv_all(int fd, void *buf, size_t len) {
+	char *p = buf;
+
+	while (len > 0) {
+		ssize_t n = recv(fd, p, len, 0);
+		if (n <= 0) {
+			if (n < 0 && errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+void client_make_record(char *buf, size_t len, char fill) {
+	unsigned char *hdr = (unsigned char *)buf;
+
+	hdr[0] = len >> 24;
+	hdr[1] = len >> 16;
+	hdr[2] = len >> 8;
+	hdr[3] = len;
+	if (len > 0) {
+		memset(buf + BIN_HDR_LEN, fill, len - 1);
+		buf[BIN_HDR_LEN + len - 1] = '\n';
+	}
+}
+
+long client_read_reply(int fd, char *scratch) {
+	unsigned char hdr[BIN_HDR_LEN];
+
+	if (!recv_all(fd, hdr, sizeof(hdr))) {
+		return -1;
+	}
+	uint32_t len = (uint32_t)hdr[0] << 24 | (uint32_t)hdr[1] << 16 | (uint32_t)hdr[2] << 8 | hdr[3];
+	uint32_t left = len;
+	while (left > 0) {
+		size_t n = left < CLIENT_SCRATCH_SIZE ? left : CLIENT_SCRATCH_SIZE;
+		if (!recv_all(fd, scratch, n)) {
+			return -1;
+		}
+		left -= n;
+	}
+	return len;
+}
@@ -0,0 +1,25 @@
+#ifndef netclient_h_
+#define netclient_h_
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The client side of the binary protocol, shared by the load tools.
+
+#define CLIENT_SCRATCH_SIZE (64 * 1024)
+
+// connects with TCP_NODELAY set. returns the fd or -1.
+int client_connect(const char *host, const char *port);
+
+bool client_send(int fd, const void *buf, size_t len);
+
+// fills buf with a record of len bytes: frame header, then len - 1 fill
+// bytes and a newline, so the work file stays readable. buf must hold
+// BIN_HDR_LEN + len bytes; an empty record is just the header.
+void client_make_record(char *buf, size_t len, char fill);
+
+// reads one framed reply into scratch, CLIENT_SCRATCH_SIZE bytes at a
+// time. returns the reply's length or -1.
+long client_read_reply(int fd, char *scratch);
+
+#endif
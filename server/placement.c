@@ -0,0 +1,137 @@
+#define _GNU_SOURCE // cpu_set_t, pthread_setaffinity_np
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "placement.h"
+
+#define NODE_DIR "/sys/devices/system/node"
+
+int placement_parse_cpulist(const char *list, cpu_set_t *set) {
+	const char *p = list;
+
+	CPU_ZERO(set);
+	while (*p != '\0' && *p != '\n') {
+		char *end;
+		if (!isdigit((unsigned char)*p)) {
+			return -1;
+		}
+		unsigned long lo = strtoul(p, &end, 10), hi = lo;
+		p = end;
+		if (*p == '-') {
+			if (!isdigit((unsigned char)p[1])) {
+				return -1;
+			}
+			hi = strtoul(p + 1, &end, 10);
+			p = end;
+		}
+		if (lo > hi || hi >= CPU_SETSIZE) {
+			return -1;
+		}
+		for (unsigned long cpu = lo; cpu <= hi; cpu++) {
+			CPU_SET(cpu, set);
+		}
+		if (*p == ',') {
+			p++;
+		} else if (*p != '\0' && *p != '\n') {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+// adds a group for node id with its cpus, less any we may not run on
+static void add_node(struct placement *pl, int id, const cpu_set_t *cpus) {
+	cpu_set_t mine;
+
+	CPU_AND(&mine, cpus, &pl->all_cpus);
+	if (CPU_COUNT(&mine) == 0 || pl->nnodes == PLACEMENT_MAX_NODES) {
+		return;
+	}
+	pl->node_ids[pl->nnodes] = id;
+	pl->node_cpus[pl->nnodes] = mine;
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &mine)) {
+			pl->cpu_node[cpu] = pl->nnodes;
+		}
+	}
+	pl->nnodes++;
+}
+
+static void read_nodes(struct placement *pl) {
+	DIR *dir = opendir(NODE_DIR);
+	struct dirent *de;
+	char path[sizeof(NODE_DIR) + 64];
+	char list[4096];
+	int id;
+
+	if (dir == NULL) {
+		return;
+	}
+	while ((de = readdir(dir)) != NULL) {
+		if (sscanf(de->d_name, "node%d", &id) != 1) {
+			continue;
+		}
+		snprintf(path, sizeof(path), NODE_DIR "/node%d/cpulist", id);
+		FILE *fp = fopen(path, "r");
+		if (fp == NULL) {
+			continue;
+		}
+		cpu_set_t cpus;
+		if (fgets(list, sizeof(list), fp) != NULL && placement_parse_cpulist(list, &cpus) == 0) {
+			add_node(pl, id, &cpus);
+		}
+		fclose(fp);
+	}
+	closedir(dir);
+}
+
+int placement_init(struct placement *pl, const char *io_cpulist, bool node_groups) {
+	memset(pl, 0, sizeof(*pl));
+	memset(pl->cpu_node, -1, sizeof(pl->cpu_node));
+	pl->node_groups = node_groups;
+	if (sched_getaffinity(0, sizeof(pl->all_cpus), &pl->all_cpus) != 0) {
+		return errno;
+	}
+
+	if (io_cpulist != NULL) {
+		if (placement_parse_cpulist(io_cpulist, &pl->io_cpus) != 0) {
+			return -1;
+		}
+		CPU_AND(&pl->io_cpus, &pl->io_cpus, &pl->all_cpus);
+		if (CPU_COUNT(&pl->io_cpus) == 0) {
+			return -1;
+		}
+		pl->pin_io = true;
+	}
+
+	read_nodes(pl);
+	if (pl->nnodes == 0) {
+		add_node(pl, 0, &pl->all_cpus);
+	}
+	return 0;
+}
+
+int placement_conn_node(struct placement *pl, int conn_fd) {
+	int cpu;
+	socklen_t len = sizeof(cpu);
+
+	if (!pl->node_groups || pl->nnodes == 1) {
+		return 0;
+	}
+	if (getsockopt(conn_fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0 &&
+	    cpu >= 0 && cpu < CPU_SETSIZE && pl->cpu_node[cpu] != -1) {
+		return pl->cpu_node[cpu];
+	}
+	return pl->next_node++ % pl->nnodes;
+}
+
+int placement_pin(pthread_t tid, const cpu_set_t *cpus) {
+	return pthread_setaffinity_np(tid, sizeof(*cpus), cpus);
+}
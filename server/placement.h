@@ -0,0 +1,42 @@
+#ifndef placement_h_
+#define placement_h_
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+
+// Where aesdsocket's threads run.  The I/O threads (accept, timestamp and
+// the registry's reaper) can be pinned to a cpu list.  With node groups,
+// each connection is served by a thread pinned to the NUMA node of the
+// cpu that received its packets, as SO_INCOMING_CPU reports it, and draws
+// its state from that node's connection pool.  The layout comes from
+// /sys/devices/system/node; without it the machine is one node.
+
+#define PLACEMENT_MAX_NODES 64
+
+struct placement {
+	int nnodes;
+	int node_ids[PLACEMENT_MAX_NODES];	// as numbered by the kernel
+	cpu_set_t node_cpus[PLACEMENT_MAX_NODES];
+	int cpu_node[CPU_SETSIZE];		// group of each cpu, or -1
+	cpu_set_t all_cpus;			// what the process may run on
+	cpu_set_t io_cpus;
+	bool pin_io;
+	bool node_groups;
+	unsigned next_node;			// for connections with no known cpu
+};
+
+// parses a list like "0-3,8,10-11". returns 0, or -1 if malformed.
+int placement_parse_cpulist(const char *, cpu_set_t *);
+
+// io_cpulist may be NULL. returns 0, -1 if the list is malformed or
+// names no cpu the process may use, or an errno value if the cpus the
+// process may use cannot be read.
+int placement_init(struct placement *, const char *io_cpulist, bool node_groups);
+
+// the node group that should serve a freshly accepted connection
+int placement_conn_node(struct placement *, int conn_fd);
+
+// returns 0 or an errno value
+int placement_pin(pthread_t, const cpu_set_t *);
+
+#endif
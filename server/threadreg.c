@@ -0,0 +1,188 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <time.h>
+
+#include "threadreg.h"
+
+// Runs the thread's work, then hands the entry to the reaper.  Threads must
+// return rather than call pthread_exit so this always runs.
+static void *thread_registry_trampoline(void *entry_void) {
+	struct thread_registry_entry *entry = entry_void;
+	struct thread_registry *reg = entry->reg;
+
+	void *ret = entry->start_routine(entry->arg);
+
+	pthread_mutex_lock(&reg->lock);
+	entry->tid = pthread_self();
+	STAILQ_INSERT_TAIL(&reg->done, entry, done_entries);
+	pthread_cond_signal(&reg->done_cond);
+	pthread_mutex_unlock(&reg->lock);
+
+	return ret;
+}
+
+// Joins every thread as soon as it queues itself as done.
+static void *thread_registry_reaper(void *reg_void) {
+	struct thread_registry *reg = reg_void;
+	struct thread_registry_entry *entry;
+
+	pthread_mutex_lock(&reg->lock);
+	while (true) {
+		while (STAILQ_EMPTY(&reg->done) && !(reg->stopping && reg->live == 0)) {
+			pthread_cond_wait(&reg->done_cond, &reg->lock);
+		}
+		if (STAILQ_EMPTY(&reg->done)) {
+			break;
+		}
+
+		entry = STAILQ_FIRST(&reg->done);
+		STAILQ_REMOVE_HEAD(&reg->done, done_entries);
+		pthread_mutex_unlock(&reg->lock);
+
+		// the thread is past its last use of the entry, join returns promptly
+		pthread_join(entry->tid, NULL);
+
+		pthread_mutex_lock(&reg->lock);
+		if (reg->nspare < THREAD_REGISTRY_MAX_SPARE) {
+			STAILQ_INSERT_HEAD(&reg->spare, entry, done_entries);
+			reg->nspare++;
+		} else {
+			free(entry);
+		}
+		reg->reaped++;
+		if (--reg->live == 0) {
+			pthread_cond_broadcast(&reg->idle_cond);
+		}
+	}
+	pthread_mutex_unlock(&reg->lock);
+
+	return NULL;
+}
+
+// stack_size of 0 keeps the default thread stack size.
+// returns 0 on success or an errno value.
+int thread_registry_init(struct thread_registry *reg, size_t stack_size) {
+	int err;
+
+	memset(reg, 0, sizeof(*reg));
+	pthread_mutex_init(&reg->lock, NULL);
+	pthread_cond_init(&reg->done_cond, NULL);
+	pthread_cond_init(&reg->idle_cond, NULL);
+	STAILQ_INIT(&reg->done);
+	STAILQ_INIT(&reg->spare);
+
+	pthread_attr_init(&reg->attr);
+	if (stack_size != 0) {
+		err = pthread_attr_setstacksize(&reg->attr, stack_size);
+		if (err != 0) {
+			fprintf(stderr, "Could not set thread stack size %zu: %s\n", stack_size, strerror(err));
+			return err;
+		}
+	}
+
+	return pthread_create(&reg->reaper, NULL, thread_registry_reaper, reg);
+}
+
+// Starts start_routine(arg) on a new thread owned by the registry.
+// returns 0 on success or an errno value.
+int thread_registry_spawn(struct thread_registry *reg, void *(*start_routine)(void *), void *arg) {
+	return thread_registry_spawn_attr(reg, &reg->attr, start_routine, arg);
+}
+
+// Entries of joined threads are reused, so steady churn does not malloc.
+int thread_registry_spawn_attr(struct thread_registry *reg, const pthread_attr_t *attr,
+			       void *(*start_routine)(void *), void *arg) {
+	struct thread_registry_entry *entry;
+	pthread_t tid;
+	int err;
+
+	pthread_mutex_lock(&reg->lock);
+	entry = STAILQ_FIRST(&reg->spare);
+	if (entry != NULL) {
+		STAILQ_REMOVE_HEAD(&reg->spare, done_entries);
+		reg->nspare--;
+	} else {
+		entry = malloc(sizeof(struct thread_registry_entry));
+		if (entry == NULL) {
+			pthread_mutex_unlock(&reg->lock);
+			return ENOMEM;
+		}
+		reg->allocated++;
+	}
+	reg->live++;
+	pthread_mutex_unlock(&reg->lock);
+
+	entry->start_routine = start_routine;
+	entry->arg = arg;
+	entry->reg = reg;
+
+	err = pthread_create(&tid, attr, thread_registry_trampoline, entry);
+	if (err != 0) {
+		pthread_mutex_lock(&reg->lock);
+		STAILQ_INSERT_HEAD(&reg->spare, entry, done_entries);
+		reg->nspare++;
+		if (--reg->live == 0) {
+			pthread_cond_broadcast(&reg->idle_cond);
+		}
+		pthread_mutex_unlock(&reg->lock);
+	}
+
+	return err;
+}
+
+size_t thread_registry_live(struct thread_registry *reg) {
+	pthread_mutex_lock(&reg->lock);
+	size_t live = reg->live;
+	pthread_mutex_unlock(&reg->lock);
+	return live;
+}
+
+// Waits up to timeout_ms for every registered thread to finish and be joined.
+// returns true if none is left.
+bool thread_registry_wait_idle(struct thread_registry *reg, int timeout_ms) {
+	struct timespec deadline;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout_ms / 1000;
+	deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&reg->lock);
+	while (reg->live != 0 && pthread_cond_timedwait(&reg->idle_cond, &reg->lock, &deadline) != ETIMEDOUT) {
+	}
+	bool idle = reg->live == 0;
+	pthread_mutex_unlock(&reg->lock);
+	return idle;
+}
+
+// Waits for every registered thread to finish and be joined, then stops the reaper.
+void thread_registry_destroy(struct thread_registry *reg) {
+	pthread_mutex_lock(&reg->lock);
+	while (reg->live != 0) {
+		pthread_cond_wait(&reg->idle_cond, &reg->lock);
+	}
+	reg->stopping = true;
+	pthread_cond_signal(&reg->done_cond);
+	pthread_mutex_unlock(&reg->lock);
+
+	pthread_join(reg->reaper, NULL);
+
+	struct thread_registry_entry *entry;
+	while ((entry = STAILQ_FIRST(&reg->spare)) != NULL) {
+		STAILQ_REMOVE_HEAD(&reg->spare, done_entries);
+		free(entry);
+	}
+
+	pthread_attr_destroy(&reg->attr);
+	pthread_cond_destroy(&reg->idle_cond);
+	pthread_cond_destroy(&reg->done_cond);
+	pthread_mutex_destroy(&reg->lock);
+}
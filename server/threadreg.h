@@ -0,0 +1,50 @@
+#ifndef threadreg_h_
+#define threadreg_h_
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/queue.h>
+
+#define THREAD_REGISTRY_MAX_SPARE 64
+
+struct thread_registry;
+
+struct thread_registry_entry {
+	pthread_t tid;
+	void *(*start_routine)(void *);
+	void *arg;
+	struct thread_registry *reg;
+	STAILQ_ENTRY(thread_registry_entry) done_entries;
+};
+
+STAILQ_HEAD(thread_registry_done, thread_registry_entry);
+
+// Tracks detached-style worker threads.  Each thread queues itself on exit and
+// the registry's reaper joins it straight away and keeps its entry for the
+// next spawn, so neither stacks nor entries accumulate however many threads
+// come and go.
+struct thread_registry {
+	pthread_mutex_t lock;
+	pthread_cond_t done_cond;  // signalled when done gains an entry or on shutdown
+	pthread_cond_t idle_cond;  // signalled when live drops to zero
+	pthread_attr_t attr;
+	struct thread_registry_done done;
+	size_t live;               // started and not yet joined
+	unsigned long reaped;
+	struct thread_registry_done spare; // joined entries kept for reuse
+	size_t nspare;
+	unsigned long allocated;           // entries ever malloc'd
+	bool stopping;
+	pthread_t reaper;
+};
+
+int thread_registry_init(struct thread_registry *, size_t stack_size);
+int thread_registry_spawn(struct thread_registry *, void *(*)(void *), void *);
+// as thread_registry_spawn, with attributes other than the registry's own
+int thread_registry_spawn_attr(struct thread_registry *, const pthread_attr_t *,
+			       void *(*)(void *), void *);
+size_t thread_registry_live(struct thread_registry *);
+bool thread_registry_wait_idle(struct thread_registry *, int timeout_ms);
+void thread_registry_destroy(struct thread_registry *);
+
+#endif
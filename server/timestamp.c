@@ -4,18 +4,17 @@
 #include <sys/wait.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include <poll.h>
 
 #include "timestamp.h"
 #include "aesdsocket.h"
 
-void write_timestamp_to_work_file(FILE *fp, struct tm *stamp_time) {
+void write_timestamp_to_work_file(struct channel_table *channels, struct tm *stamp_time) {
 	char buffer[40];
-	strftime(buffer, 40, "timestamp:%a %b %d %T %Y\n", stamp_time);
+	size_t len = strftime(buffer, 40, "timestamp:%a %b %d %T %Y\n", stamp_time);
 
-	pthread_mutex_lock(&work_file_lock);
-	fseek(fp, 0, SEEK_END);
-	fputs(buffer, fp);
-	pthread_mutex_unlock(&work_file_lock);
+	struct iovec iov = {.iov_base = buffer, .iov_len = len};
+	channels_append_all(channels, &iov, 1);
 }
 
 void *timestamp_worker(void *ts_void) {
@@ -25,12 +24,16 @@ void *timestamp_worker(void *ts_void) {
 	ts_worker_args ts = *(ts_worker_args *)ts_void;
 	struct tm *tm_info;
 
+	struct pollfd pfd = {.fd = shutdown_fd, .events = POLLIN};
 	while (cease == false) {
-		sleep(ts.interval_sec);
+		// sleeps for the interval unless woken for shutdown
+		if (poll(&pfd, 1, ts.interval_sec * 1000) != 0) {
+			continue;
+		}
 		time_t timer = time(NULL);
 		tm_info = localtime(&timer);
 		if (cease == false) {
-			write_timestamp_to_work_file(ts.fp, tm_info);
+			write_timestamp_to_work_file(ts.channels, tm_info);
 		}
 	}
 
@@ -2,8 +2,10 @@
 #define timestamp_h_
 #include <stdio.h>
 
+#include "channels.h"
+
 typedef struct ts_worker_args {
-	FILE *fp;
+	struct channel_table *channels;
 	int interval_sec;
 } ts_worker_args;
 
@@ -0,0 +1,163 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+
+#include "trace.h"
+
+#define VARINT_MAX_LEN 10
+
+uint64_t trace_clock_us(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static size_t put_varint(unsigned char *p, uint64_t v) {
+	size_t n = 0;
+
+	while (v >= 0x80) {
+		p[n++] = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	p[n++] = v;
+	return n;
+}
+
+static int get_varint(FILE *fp, uint64_t *v) {
+	int c;
+
+	*v = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if ((c = getc(fp)) == EOF) {
+			return -1;
+		}
+		*v |= (uint64_t)(c & 0x7f) << shift;
+		if (!(c & 0x80)) {
+			return 0;
+		}
+	}
+	return -1;
+}
+
+int trace_open(struct trace *t, const char *path) {
+	memset(t, 0, sizeof(*t));
+	t->fp = fopen(path, "w");
+	if (t->fp == NULL) {
+		return -1;
+	}
+	if (fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_LEN, t->fp) != TRACE_MAGIC_LEN) {
+		fclose(t->fp);
+		return -1;
+	}
+	pthread_mutex_init(&t->lock, NULL);
+	t->start_us = t->last_us = trace_clock_us();
+	return 0;
+}
+
+// writes one record for an event at at_us; the caller holds the lock.
+// an event timed before the previous record, such as a packet received
+// before another connection's record was written, takes that record's time.
+static void put_record(struct trace *t, int type, uint64_t at_us, uint64_t conn, bool has_arg, uint64_t arg) {
+	unsigned char rec[1 + 3 * VARINT_MAX_LEN];
+	uint64_t now = at_us > t->last_us ? at_us : t->last_us;
+	size_t n = 0;
+
+	rec[n++] = type;
+	n += put_varint(rec + n, now - t->last_us);
+	n += put_varint(rec + n, conn);
+	if (has_arg) {
+		n += put_varint(rec + n, arg);
+	}
+	t->last_us = now;
+	if (fwrite(rec, 1, n, t->fp) != n) {
+		syslog(LOG_USER|LOG_ERR, "Could not write trace: %s", strerror(errno));
+	}
+}
+
+uint64_t trace_conn_open(struct trace *t) {
+	pthread_mutex_lock(&t->lock);
+	uint64_t conn = t->next_conn++;
+	put_record(t, TRACE_OPEN, trace_clock_us(), conn, false, 0);
+	pthread_mutex_unlock(&t->lock);
+	return conn;
+}
+
+void trace_conn_mode(struct trace *t, uint64_t conn, int mode) {
+	pthread_mutex_lock(&t->lock);
+	put_record(t, TRACE_MODE, trace_clock_us(), conn, true, mode);
+	pthread_mutex_unlock(&t->lock);
+}
+
+void trace_conn_channel(struct trace *t, uint64_t conn, const char *name) {
+	size_t len = strlen(name);
+
+	pthread_mutex_lock(&t->lock);
+	put_record(t, TRACE_CHANNEL, trace_clock_us(), conn, true, len);
+	if (fwrite(name, 1, len, t->fp) != len) {
+		syslog(LOG_USER|LOG_ERR, "Could not write trace: %s", strerror(errno));
+	}
+	pthread_mutex_unlock(&t->lock);
+}
+
+void trace_packets(struct trace *t, uint64_t conn, uint64_t at_us, const struct iovec *iov, size_t count) {
+	pthread_mutex_lock(&t->lock);
+	for (size_t i = 0; i < count; i++) {
+		put_record(t, TRACE_PACKET, at_us, conn, true, iov[i].iov_len);
+	}
+	pthread_mutex_unlock(&t->lock);
+}
+
+void trace_conn_close(struct trace *t, uint64_t conn) {
+	pthread_mutex_lock(&t->lock);
+	put_record(t, TRACE_CLOSE, trace_clock_us(), conn, false, 0);
+	pthread_mutex_unlock(&t->lock);
+}
+
+void trace_close(struct trace *t) {
+	if (fclose(t->fp) != 0) {
+		syslog(LOG_USER|LOG_ERR, "Could not write trace: %s", strerror(errno));
+	}
+	pthread_mutex_destroy(&t->lock);
+}
+
+int trace_read_header(FILE *fp) {
+	char magic[TRACE_MAGIC_LEN];
+
+	if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic) ||
+	    memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0) {
+		return -1;
+	}
+	return 0;
+}
+
+int trace_read_event(FILE *fp, struct trace_event *ev) {
+	uint64_t dt;
+	int type = getc(fp);
+
+	if (type == EOF) {
+		return 0;
+	}
+	if ((type != TRACE_OPEN && type != TRACE_MODE && type != TRACE_PACKET && type != TRACE_CLOSE &&
+	     type != TRACE_CHANNEL) ||
+	    get_varint(fp, &dt) != 0 || get_varint(fp, &ev->conn) != 0) {
+		return -1;
+	}
+	ev->type = type;
+	ev->time_us += dt;
+	ev->arg = 0;
+	if ((type == TRACE_MODE || type == TRACE_PACKET || type == TRACE_CHANNEL) && get_varint(fp, &ev->arg) != 0) {
+		return -1;
+	}
+	if (type == TRACE_CHANNEL) {
+		if (ev->arg == 0 || ev->arg > CHANNEL_NAME_MAX || fread(ev->channel, 1, ev->arg, fp) != ev->arg) {
+			return -1;
+		}
+		ev->channel[ev->arg] = '\0';
+	}
+	return 1;
+}
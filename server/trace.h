@@ -0,0 +1,78 @@
+#ifndef trace_h_
+#define trace_h_
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/uio.h>
+
+#include "channels.h"
+
+// Traffic traces, as written by aesdsocket -C and replayed by aesdreplay.
+// A trace records when connections arrive and close and the size of every
+// packet, never the payload.  The file is TRACE_MAGIC followed by records
+// of a type byte and LEB128 varints: the microseconds since the previous
+// record, the connection id, then for a packet its size, for a mode
+// record a TRACE_MODE_* value and for a channel record the length of the
+// name the connection selected followed by the name itself.  Connections
+// on the default channel have no channel record.  Connection ids count up
+// from 0 in order of arrival.  A packet is timed by when its last byte
+// was received, not when it was committed; record times are raised where
+// needed so they never go backwards in the file.
+
+#define TRACE_MAGIC "AESDTRC2"
+#define TRACE_MAGIC_LEN (sizeof(TRACE_MAGIC) - 1)
+
+#define TRACE_OPEN 'O'
+#define TRACE_MODE 'M'
+#define TRACE_PACKET 'P'
+#define TRACE_CLOSE 'C'
+#define TRACE_CHANNEL 'N'
+
+#define TRACE_MODE_TEXT 0
+#define TRACE_MODE_FRAMED 1
+#define TRACE_MODE_SEGMENTS 2
+
+struct trace {
+	pthread_mutex_t lock;
+	FILE *fp;
+	uint64_t start_us;
+	uint64_t last_us;
+	uint64_t next_conn;
+};
+
+struct trace_event {
+	int type;
+	uint64_t time_us;	// since the start of the capture
+	uint64_t conn;
+	uint64_t arg;		// packet size or mode
+	char channel[CHANNEL_NAME_MAX + 1];	// set by a channel record
+};
+
+// creates path, replacing any earlier trace. returns 0 or -1.
+int trace_open(struct trace *, const char *path);
+
+// records a new connection and returns its id
+uint64_t trace_conn_open(struct trace *);
+void trace_conn_mode(struct trace *, uint64_t conn, int mode);
+// name is a valid channel name, see channel_name_valid
+void trace_conn_channel(struct trace *, uint64_t conn, const char *name);
+// the clock record times are read from, in microseconds
+uint64_t trace_clock_us(void);
+
+// records a batch of packets received at at_us, as read from
+// trace_clock_us, under one lock acquisition
+void trace_packets(struct trace *, uint64_t conn, uint64_t at_us, const struct iovec *, size_t);
+void trace_conn_close(struct trace *, uint64_t conn);
+
+void trace_close(struct trace *);
+
+// checks the magic of a trace opened for reading. returns 0 or -1.
+int trace_read_header(FILE *);
+
+// reads the next record, keeping a running time in ev->time_us, so ev
+// must start zeroed. returns 1, 0 at the end of the trace, or -1 if it is
+// damaged.
+int trace_read_event(FILE *, struct trace_event *ev);
+
+#endif
@@ -0,0 +1,353 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "aesdsocket.h"
+#include "helpers.h"
+#include "lz4.h"
+#include "worklog.h"
+
+static void put_be32(unsigned char *p, uint32_t v) {
+	put_frame_len(p, v);
+}
+
+static uint32_t get_be32(const unsigned char *p) {
+	return get_frame_len(p);
+}
+
+// checks the segment headers of a compressed file and totals their raw bytes
+static int scan_segments(struct work_log *log, long size) {
+	unsigned char hdr[WORK_LOG_SEG_HDR_LEN];
+	long pos = WORK_LOG_Z_MAGIC_LEN;
+
+	while (pos < size) {
+		if (fseek(log->fp, pos, SEEK_SET) != 0 || fread(hdr, 1, sizeof(hdr), log->fp) != sizeof(hdr)) {
+			break;
+		}
+		uint32_t raw = get_be32(hdr), stored = get_be32(hdr + 4);
+		if (raw > WORK_LOG_SEGMENT_SIZE || stored > raw) {
+			break;
+		}
+		log->raw_size += raw;
+		pos += WORK_LOG_SEG_HDR_LEN + stored;
+	}
+	if (pos != size) {
+		fprintf(stderr, "Compressed work file is damaged at offset %ld\n", pos);
+		return -1;
+	}
+	return 0;
+}
+
+int work_log_init(struct work_log *log, FILE *fp, bool compress) {
+	char magic[WORK_LOG_Z_MAGIC_LEN];
+
+	memset(log, 0, sizeof(*log));
+	pthread_mutex_init(&log->lock, NULL);
+	log->fp = fp;
+
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	if (size < 0) {
+		return -1;
+	}
+	if (size == 0) {
+		log->compressed = compress;
+		if (compress && (fwrite(WORK_LOG_Z_MAGIC, 1, WORK_LOG_Z_MAGIC_LEN, fp) != WORK_LOG_Z_MAGIC_LEN ||
+				 fflush(fp) != 0)) {
+			return -1;
+		}
+	} else {
+		fseek(fp, 0, SEEK_SET);
+		log->compressed = size >= (long)WORK_LOG_Z_MAGIC_LEN &&
+				  fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+				  memcmp(magic, WORK_LOG_Z_MAGIC, sizeof(magic)) == 0;
+		if (compress && !log->compressed) {
+			fprintf(stderr, "work file holds plain history, keeping it uncompressed\n");
+		}
+		if (log->compressed) {
+			if (scan_segments(log, size) != 0) {
+				return -1;
+			}
+		} else {
+			log->raw_size = size;
+		}
+	}
+
+	if (log->compressed) {
+		log->tail = malloc(WORK_LOG_SEGMENT_SIZE);
+		log->zbuf = malloc(WORK_LOG_SEG_HDR_LEN + LZ4_COMPRESS_BOUND(WORK_LOG_SEGMENT_SIZE));
+		if (log->tail == NULL || log->zbuf == NULL) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+// compresses the tail into a new segment at the end of the file, storing it
+// as is when compression does not make it smaller
+static void seal_tail(struct work_log *log) {
+	unsigned char *seg = (unsigned char *)log->zbuf;
+	size_t stored = lz4_compress_block((uint8_t *)log->tail, log->tail_len,
+					   seg + WORK_LOG_SEG_HDR_LEN, log->tail_len - 1);
+	if (stored == 0) {
+		stored = log->tail_len;
+		memcpy(seg + WORK_LOG_SEG_HDR_LEN, log->tail, stored);
+	}
+	put_be32(seg, log->tail_len);
+	put_be32(seg + 4, stored);
+
+	fseek(log->fp, 0, SEEK_END);
+	if (fwrite(seg, 1, WORK_LOG_SEG_HDR_LEN + stored, log->fp) != WORK_LOG_SEG_HDR_LEN + stored) {
+		syslog(LOG_USER|LOG_ERR, "Could not write work file segment: %s", strerror(errno));
+	}
+	log->tail_len = 0;
+}
+
+void work_log_append(struct work_log *log, const struct iovec *iov, size_t count) {
+	pthread_mutex_lock(&log->lock);
+	if (!log->compressed) {
+		fseek(log->fp, 0, SEEK_END);
+	}
+	for (size_t i = 0; i < count; i++) {
+		const char *p = iov[i].iov_base;
+		size_t len = iov[i].iov_len;
+
+		log->raw_size += len;
+		if (!log->compressed) {
+			fwrite(p, 1, len, log->fp);
+			continue;
+		}
+		while (len > 0) {
+			size_t n = WORK_LOG_SEGMENT_SIZE - log->tail_len;
+			if (n > len) {
+				n = len;
+			}
+			memcpy(log->tail + log->tail_len, p, n);
+			log->tail_len += n;
+			p += n;
+			len -= n;
+			if (log->tail_len == WORK_LOG_SEGMENT_SIZE) {
+				seal_tail(log);
+			}
+		}
+	}
+	pthread_mutex_unlock(&log->lock);
+}
+
+// what one reply covers, fixed under the lock so the send can run without
+// it. the file only ever grows, so the bytes before end stay as they were.
+struct send_view {
+	int fd;			// the file, read with pread to leave fp alone
+	bool compressed;
+	uint64_t raw_size;
+	long end;
+	size_t tail_len;	// copied to the reader's tail
+	struct work_log_reader *rd;
+};
+
+// reads len bytes at offset, or returns false
+static bool read_at(const struct send_view *v, void *buf, size_t len, long offset) {
+	size_t got = 0;
+
+	while (got < len) {
+		ssize_t n = pread(v->fd, (char *)buf + got, len - got, offset + got);
+		if (n <= 0) {
+			if (n < 0 && errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		got += n;
+	}
+	return true;
+}
+
+// sends len bytes of buf, flagging MSG_MORE while *remaining says more follows
+static bool send_part(int conn_fd, const void *buf, size_t len, uint64_t *remaining) {
+	*remaining = len < *remaining ? *remaining - len : 0;
+	return send_all(conn_fd, buf, len, *remaining > 0 ? MSG_MORE : 0);
+}
+
+// BIN_MAX_FRAME bounds what a client may send; a reply may use the whole header
+static bool send_frame_header(int conn_fd, uint64_t len) {
+	unsigned char hdr[BIN_HDR_LEN];
+
+	if (len > UINT32_MAX) {
+		syslog(LOG_USER|LOG_ERR, "History too large to frame: %llu bytes", (unsigned long long)len);
+		return false;
+	}
+	put_frame_len(hdr, len);
+	return send_all(conn_fd, hdr, sizeof(hdr), len > 0 ? MSG_MORE : 0);
+}
+
+// copies the file from offset to the end of the view onto the socket,
+// optionally as uncompressed segments
+static bool send_file_range(const struct send_view *v, int conn_fd, long offset, bool as_segments,
+			    uint64_t *remaining) {
+	unsigned char hdr[WORK_LOG_SEG_HDR_LEN];
+
+	while (offset < v->end) {
+		size_t n = v->end - offset < WORK_LOG_SEGMENT_SIZE ? v->end - offset : WORK_LOG_SEGMENT_SIZE;
+		if (!read_at(v, v->rd->rawbuf, n, offset)) {
+			syslog(LOG_USER|LOG_ERR, "Could not read work file: %s", strerror(errno));
+			return false;
+		}
+		if (as_segments) {
+			put_be32(hdr, n);
+			put_be32(hdr + 4, n);
+			if (!send_part(conn_fd, hdr, sizeof(hdr), remaining)) {
+				return false;
+			}
+		}
+		if (!send_part(conn_fd, v->rd->rawbuf, n, remaining)) {
+			return false;
+		}
+		offset += n;
+	}
+	return true;
+}
+
+// the history as written; compressed segments are inflated one at a time
+static bool send_raw(const struct send_view *v, int conn_fd, bool framed) {
+	uint64_t remaining = v->raw_size;
+	unsigned char hdr[WORK_LOG_SEG_HDR_LEN];
+	long pos = WORK_LOG_Z_MAGIC_LEN;
+
+	if (framed && !send_frame_header(conn_fd, remaining)) {
+		return false;
+	}
+	if (!v->compressed) {
+		return send_file_range(v, conn_fd, 0, false, &remaining);
+	}
+
+	while (pos < v->end) {
+		uint32_t raw, stored;
+		const char *data = v->rd->zbuf;
+		if (!read_at(v, hdr, sizeof(hdr), pos) ||
+		    (raw = get_be32(hdr)) > WORK_LOG_SEGMENT_SIZE || (stored = get_be32(hdr + 4)) > raw ||
+		    !read_at(v, v->rd->zbuf, stored, pos + WORK_LOG_SEG_HDR_LEN)) {
+			syslog(LOG_USER|LOG_ERR, "Damaged segment in work file");
+			return false;
+		}
+		if (stored < raw) {
+			if (lz4_decompress_block((uint8_t *)v->rd->zbuf, stored, (uint8_t *)v->rd->rawbuf,
+						 WORK_LOG_SEGMENT_SIZE) != raw) {
+				syslog(LOG_USER|LOG_ERR, "Damaged segment in work file");
+				return false;
+			}
+			data = v->rd->rawbuf;
+		}
+		if (!send_part(conn_fd, data, raw, &remaining)) {
+			return false;
+		}
+		pos += WORK_LOG_SEG_HDR_LEN + stored;
+	}
+	return v->tail_len == 0 || send_part(conn_fd, v->rd->tail, v->tail_len, &remaining);
+}
+
+// the history as segments, passing stored segments through untouched
+static bool send_segments(const struct send_view *v, int conn_fd) {
+	unsigned char hdr[WORK_LOG_SEG_HDR_LEN];
+	uint64_t remaining;
+
+	if (!v->compressed) {
+		// a plain log goes out as uncompressed segments
+		uint64_t nsegs = (v->end + WORK_LOG_SEGMENT_SIZE - 1) / WORK_LOG_SEGMENT_SIZE;
+		remaining = v->end + nsegs * WORK_LOG_SEG_HDR_LEN;
+		return send_frame_header(conn_fd, remaining) &&
+		       send_file_range(v, conn_fd, 0, true, &remaining);
+	}
+
+	remaining = v->end - WORK_LOG_Z_MAGIC_LEN;
+	if (v->tail_len > 0) {
+		remaining += WORK_LOG_SEG_HDR_LEN + v->tail_len;
+	}
+	if (!send_frame_header(conn_fd, remaining) ||
+	    !send_file_range(v, conn_fd, WORK_LOG_Z_MAGIC_LEN, false, &remaining)) {
+		return false;
+	}
+	if (v->tail_len == 0) {
+		return true;
+	}
+	put_be32(hdr, v->tail_len);
+	put_be32(hdr + 4, v->tail_len);
+	return send_part(conn_fd, hdr, sizeof(hdr), &remaining) &&
+	       send_part(conn_fd, v->rd->tail, v->tail_len, &remaining);
+}
+
+// allocates what the reader needs for this log on first use
+static bool reader_ready(struct work_log_reader *rd, bool compressed) {
+	if (rd->rawbuf == NULL) {
+		rd->rawbuf = malloc(WORK_LOG_SEGMENT_SIZE);
+	}
+	if (compressed && rd->tail == NULL) {
+		rd->tail = malloc(WORK_LOG_SEGMENT_SIZE);
+	}
+	if (compressed && rd->zbuf == NULL) {
+		rd->zbuf = malloc(WORK_LOG_SEGMENT_SIZE);
+	}
+	if (rd->rawbuf == NULL || (compressed && (rd->tail == NULL || rd->zbuf == NULL))) {
+		syslog(LOG_USER|LOG_ERR, "Could not alloc mem for reply buffers");
+		return false;
+	}
+	return true;
+}
+
+bool work_log_send(struct work_log *log, struct work_log_reader *rd, int conn_fd, enum work_log_reply how) {
+	struct send_view v = {.fd = fileno(log->fp), .compressed = log->compressed, .rd = rd};
+
+	if (!reader_ready(rd, log->compressed)) {
+		return false;
+	}
+	// only the snapshot is taken under the lock; a slow client must not
+	// hold up appends or the replies to everyone else on the channel
+	pthread_mutex_lock(&log->lock);
+	fflush(log->fp);
+	fseek(log->fp, 0, SEEK_END);
+	v.end = ftell(log->fp);
+	v.raw_size = log->compressed ? log->raw_size : (uint64_t)v.end;
+	v.tail_len = log->tail_len;
+	if (v.tail_len > 0) {
+		memcpy(rd->tail, log->tail, v.tail_len);
+	}
+	pthread_mutex_unlock(&log->lock);
+
+	if (v.end < 0) {
+		return false;
+	}
+	if (how == WORK_LOG_SEGMENTS) {
+		return send_segments(&v, conn_fd);
+	}
+	return send_raw(&v, conn_fd, how == WORK_LOG_FRAMED);
+}
+
+void work_log_reader_free(struct work_log_reader *rd) {
+	free(rd->rawbuf);
+	free(rd->zbuf);
+	free(rd->tail);
+}
+
+void work_log_sync(struct work_log *log) {
+	pthread_mutex_lock(&log->lock);
+	if (log->compressed && log->tail_len > 0) {
+		seal_tail(log);
+	}
+	fflush(log->fp);
+	pthread_mutex_unlock(&log->lock);
+}
+
+void work_log_destroy(struct work_log *log) {
+	if (log->fp != NULL) {
+		fclose(log->fp);
+	}
+	free(log->tail);
+	free(log->zbuf);
+	pthread_mutex_destroy(&log->lock);
+}
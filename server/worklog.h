@@ -0,0 +1,65 @@
+#ifndef worklog_h_
+#define worklog_h_
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/uio.h>
+
+// The history clients append to and get back, with the lock that orders
+// those appends.  A log is either plain, the work file holding exactly what
+// was written, or compressed: the file starts with WORK_LOG_Z_MAGIC and
+// holds LZ4 segments of up to WORK_LOG_SEGMENT_SIZE bytes each, preceded by
+// a header of two 32-bit big-endian lengths, raw then stored.  When the
+// stored length equals the raw length the segment is not compressed.  Bytes
+// that do not yet fill a segment wait in memory in the tail.
+
+#define WORK_LOG_Z_MAGIC "AESDLZ1\n"
+#define WORK_LOG_Z_MAGIC_LEN (sizeof(WORK_LOG_Z_MAGIC) - 1)
+#define WORK_LOG_SEG_HDR_LEN 8
+#define WORK_LOG_SEGMENT_SIZE (32 * 1024)
+
+enum work_log_reply {
+	WORK_LOG_RAW,		// the history as written
+	WORK_LOG_FRAMED,	// one binary frame holding the history
+	WORK_LOG_SEGMENTS,	// one binary frame holding the history's segments
+};
+
+struct work_log {
+	pthread_mutex_t lock;
+	FILE *fp;
+	bool compressed;
+	uint64_t raw_size;	// bytes of history, whatever the storage
+	char *tail;
+	size_t tail_len;
+	char *zbuf;		// scratch for sealing segments
+};
+
+// a client's buffers for sending it the history. the log's lock is held
+// only while the file length and tail are noted, so a slow client does not
+// stall appends or other clients' replies; what was noted is then read
+// back with pread, as the file only grows.
+struct work_log_reader {
+	char *rawbuf;
+	char *zbuf;
+	char *tail;		// the log's tail as of the reply
+};
+
+// takes over fp. an empty file is set up compressed if asked; otherwise
+// the format follows what the file already holds. returns 0 or -1.
+int work_log_init(struct work_log *, FILE *, bool compress);
+
+void work_log_append(struct work_log *, const struct iovec *, size_t);
+
+// sends the whole history to a client in the given form. the reader's
+// buffers are allocated on first use. returns false if the client went away.
+bool work_log_send(struct work_log *, struct work_log_reader *, int conn_fd, enum work_log_reply);
+
+void work_log_reader_free(struct work_log_reader *);
+
+// seals the tail into the file so another process can take the file over
+void work_log_sync(struct work_log *);
+
+void work_log_destroy(struct work_log *);
+
+#endif
@@ -0,0 +1,77 @@
+#include "unity.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include "../../examples/systemcalls/systemcalls.h"
+
+/**
+* Runs commands exiting with different statuses through do_exec_batch() and checks
+*   each status is reported against its own command, and that one failure fails the batch.
+*/
+void test_exec_batch_mixed_status()
+{
+    char * const ok_cmd[] = { "/bin/true", NULL };
+    char * const fail_cmd[] = { "/bin/false", NULL };
+    char * const exit3_cmd[] = { "/bin/sh", "-c", "exit 3", NULL };
+    struct exec_cmd cmds[] = {
+        { .argv = ok_cmd },
+        { .argv = fail_cmd },
+        { .argv = exit3_cmd },
+        { .argv = ok_cmd },
+    };
+
+    TEST_ASSERT_FALSE_MESSAGE(do_exec_batch(cmds, 4, 2), "batch with failing commands succeeded");
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_TRUE_MESSAGE(WIFEXITED(cmds[i].status), "command did not exit normally");
+    }
+    TEST_ASSERT_EQUAL_INT(0, WEXITSTATUS(cmds[0].status));
+    TEST_ASSERT_EQUAL_INT(1, WEXITSTATUS(cmds[1].status));
+    TEST_ASSERT_EQUAL_INT(3, WEXITSTATUS(cmds[2].status));
+    TEST_ASSERT_EQUAL_INT(0, WEXITSTATUS(cmds[3].status));
+
+    struct exec_cmd all_ok[] = { { .argv = ok_cmd }, { .argv = ok_cmd } };
+    TEST_ASSERT_TRUE_MESSAGE(do_exec_batch(all_ok, 2, 0), "batch of successful commands failed");
+}
+
+/**
+* A command which cannot be started is reported with status -1, and the rest of the
+*   batch still runs.
+*/
+void test_exec_batch_spawn_failure()
+{
+    char * const missing_cmd[] = { "/nonexistent/command", NULL };
+    char * const ok_cmd[] = { "/bin/true", NULL };
+    struct exec_cmd cmds[] = {
+        { .argv = missing_cmd },
+        { .argv = ok_cmd },
+    };
+
+    TEST_ASSERT_FALSE_MESSAGE(do_exec_batch(cmds, 2, 1), "batch with a missing command succeeded");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(-1, cmds[0].status, "missing command not reported as -1");
+    TEST_ASSERT_TRUE(WIFEXITED(cmds[1].status));
+    TEST_ASSERT_EQUAL_INT(0, WEXITSTATUS(cmds[1].status));
+}
+
+/**
+* Standard output is collected for commands with capture_stdout set, and only for those.
+*/
+void test_exec_batch_captured_output()
+{
+    char * const hello_cmd[] = { "/bin/echo", "hello", NULL };
+    char * const many_cmd[] = { "/bin/sh", "-c", "i=0; while [ $i -lt 20000 ]; do echo line; i=$((i+1)); done", NULL };
+    struct exec_cmd cmds[] = {
+        { .argv = hello_cmd, .capture_stdout = true },
+        { .argv = many_cmd, .capture_stdout = true },
+        { .argv = hello_cmd },
+    };
+
+    TEST_ASSERT_TRUE_MESSAGE(do_exec_batch(cmds, 3, 3), "batch of successful commands failed");
+    TEST_ASSERT_EQUAL_STRING("hello\n", cmds[0].output);
+    TEST_ASSERT_EQUAL_size_t(6, cmds[0].output_len);
+    // more than a pipe buffer, so the output has to be drained while the command runs
+    TEST_ASSERT_EQUAL_size_t(20000 * 5, cmds[1].output_len);
+    TEST_ASSERT_NULL(cmds[2].output);
+    for (int i = 0; i < 3; i++) {
+        free(cmds[i].output);
+    }
+}
@@ -0,0 +1,96 @@
+#include "unity.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../../examples/systemcalls/systemcalls.h"
+
+/**
+* What the streaming callback has seen, per stream
+*/
+struct stream_tally {
+    size_t bytes[3];
+    unsigned calls;
+    unsigned stop_after;    // calls before asking for the command to be killed, 0 for never
+};
+
+static bool tally_output(int stream, const char *data, size_t len, void *arg)
+{
+    struct stream_tally *tally = arg;
+    (void)data;
+    if (stream == STDOUT_FILENO || stream == STDERR_FILENO) {
+        tally->bytes[stream] += len;
+    }
+    tally->calls++;
+    return tally->stop_after == 0 || tally->calls < tally->stop_after;
+}
+
+/**
+* A command still running at timeout_ms is killed with SIGKILL and reported as timed out.
+*/
+void test_exec_capture_timeout()
+{
+    struct exec_capture capture = { .timeout_ms = 200 };
+    time_t start = time(NULL);
+
+    TEST_ASSERT_FALSE_MESSAGE(do_exec_capture(&capture, 2, "/bin/sleep", "10"),
+            "command killed at its timeout reported success");
+    TEST_ASSERT_LESS_THAN_MESSAGE(5, time(NULL) - start, "command was not killed at its timeout");
+    TEST_ASSERT_TRUE(capture.timed_out);
+    TEST_ASSERT_TRUE(WIFSIGNALED(capture.status));
+    TEST_ASSERT_EQUAL_INT(SIGKILL, WTERMSIG(capture.status));
+    free(capture.out);
+    free(capture.err);
+}
+
+/**
+* Output past max_output is discarded without blocking the command, per stream.
+*/
+void test_exec_capture_truncation()
+{
+    struct exec_capture capture = { .max_output = 100 };
+
+    TEST_ASSERT_TRUE_MESSAGE(do_exec_capture(&capture, 3, "/bin/sh", "-c",
+            "head -c 200000 /dev/zero | tr '\\0' x; echo err >&2"),
+            "command with truncated output failed");
+    TEST_ASSERT_FALSE(capture.timed_out);
+    TEST_ASSERT_TRUE(capture.truncated);
+    TEST_ASSERT_EQUAL_size_t(100, capture.out_len);
+    TEST_ASSERT_NOT_NULL(capture.out);
+    TEST_ASSERT_EQUAL_INT('x', capture.out[99]);
+    TEST_ASSERT_EQUAL_INT('\0', capture.out[100]);
+    TEST_ASSERT_EQUAL_STRING("err\n", capture.err);
+    TEST_ASSERT_EQUAL_size_t(4, capture.err_len);
+    free(capture.out);
+    free(capture.err);
+}
+
+/**
+* With a callback, output is streamed to it by stream instead of being buffered, and the
+*   callback returning false kills the command.
+*/
+void test_exec_capture_callback()
+{
+    struct stream_tally tally = { .stop_after = 0 };
+    struct exec_capture capture = { .callback = tally_output, .callback_arg = &tally };
+
+    TEST_ASSERT_TRUE_MESSAGE(do_exec_capture(&capture, 3, "/bin/sh", "-c",
+            "head -c 100000 /dev/zero; echo error >&2"),
+            "command streamed to a callback failed");
+    TEST_ASSERT_EQUAL_size_t(100000, tally.bytes[STDOUT_FILENO]);
+    TEST_ASSERT_EQUAL_size_t(6, tally.bytes[STDERR_FILENO]);
+    TEST_ASSERT_NULL(capture.out);
+    TEST_ASSERT_NULL(capture.err);
+
+    struct stream_tally stopper = { .stop_after = 1 };
+    capture.callback_arg = &stopper;
+    TEST_ASSERT_FALSE_MESSAGE(do_exec_capture(&capture, 2, "/usr/bin/yes", "aesd"),
+            "command stopped by its callback reported success");
+    TEST_ASSERT_EQUAL_INT(1, stopper.calls);
+    TEST_ASSERT_FALSE(capture.timed_out);
+    TEST_ASSERT_TRUE(WIFSIGNALED(capture.status));
+    TEST_ASSERT_EQUAL_INT(SIGKILL, WTERMSIG(capture.status));
+}
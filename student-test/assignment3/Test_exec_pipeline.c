@@ -0,0 +1,88 @@
+#include "unity.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../../examples/systemcalls/systemcalls.h"
+
+#define PIPELINE_TEST_FILE "/tmp/aesd-pipeline-test.txt"
+
+static char * const printf_cmd[] = { "/usr/bin/printf", "b\\na\\nb\\n", NULL };
+static char * const sort_cmd[] = { "/usr/bin/sort", "-u", NULL };
+static char * const true_cmd[] = { "/bin/true", NULL };
+static char * const cat_cmd[] = { "/bin/cat", NULL };
+
+/**
+* Reads up to @param size - 1 bytes of @param path into @param buf as a string.
+*/
+static void read_test_file(const char *path, char *buf, size_t size)
+{
+    int fd = open(path, O_RDONLY);
+    TEST_ASSERT_TRUE_MESSAGE(fd >= 0, "could not open pipeline output");
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    TEST_ASSERT_TRUE_MESSAGE(n >= 0, "could not read pipeline output");
+    buf[n] = '\0';
+}
+
+/**
+* Each stage's wait status is reported in order, and any stage failing fails the pipeline.
+*/
+void test_exec_pipeline_status()
+{
+    char * const exit4_cmd[] = { "/bin/sh", "-c", "cat >/dev/null; exit 4", NULL };
+    char * const *ok_stages[] = { printf_cmd, cat_cmd, sort_cmd };
+    char * const *failing_stages[] = { printf_cmd, exit4_cmd, cat_cmd };
+    int statuses[3];
+    int null_fd = open("/dev/null", O_WRONLY|O_CLOEXEC);
+    TEST_ASSERT_TRUE(null_fd >= 0);
+
+    TEST_ASSERT_TRUE_MESSAGE(do_exec_pipeline(ok_stages, 3, null_fd, statuses),
+            "pipeline of successful stages failed");
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_TRUE(WIFEXITED(statuses[i]));
+        TEST_ASSERT_EQUAL_INT(0, WEXITSTATUS(statuses[i]));
+    }
+
+    TEST_ASSERT_FALSE_MESSAGE(do_exec_pipeline(failing_stages, 3, null_fd, statuses),
+            "pipeline with a failing stage succeeded");
+    close(null_fd);
+    TEST_ASSERT_TRUE(WIFEXITED(statuses[1]));
+    TEST_ASSERT_EQUAL_INT(4, WEXITSTATUS(statuses[1]));
+    TEST_ASSERT_TRUE(WIFEXITED(statuses[2]));
+    TEST_ASSERT_EQUAL_INT(0, WEXITSTATUS(statuses[2]));
+}
+
+/**
+* Data flows through every stage into the output file, which is truncated first.
+*/
+void test_exec_pipeline_redirect()
+{
+    char * const *stages[] = { printf_cmd, sort_cmd, cat_cmd };
+    char buf[64];
+    int fd = open(PIPELINE_TEST_FILE, O_WRONLY|O_TRUNC|O_CREAT, 0644);
+    TEST_ASSERT_TRUE_MESSAGE(fd >= 0, "could not create pipeline output");
+    TEST_ASSERT_TRUE(write(fd, "stale contents\n", 15) == 15);
+    close(fd);
+
+    TEST_ASSERT_TRUE_MESSAGE(do_exec_pipeline_redirect(PIPELINE_TEST_FILE, stages, 3, NULL),
+            "redirected pipeline failed");
+    read_test_file(PIPELINE_TEST_FILE, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_STRING("a\nb\n", buf);
+    unlink(PIPELINE_TEST_FILE);
+}
+
+/**
+* A stage whose output cannot be redirected is not started, and fails the pipeline.
+*/
+void test_exec_pipeline_bad_output()
+{
+    char * const *stages[] = { true_cmd, cat_cmd };
+    int statuses[2];
+
+    // one past the highest possible descriptor, which posix_spawn cannot dup
+    TEST_ASSERT_FALSE_MESSAGE(do_exec_pipeline(stages, 2, getdtablesize(), statuses),
+            "pipeline into an invalid descriptor succeeded");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(-1, statuses[1], "stage with a bad redirection was started");
+}